@@ -0,0 +1,71 @@
+/**
+ * @file arena.c
+ * @author Xianwei Zou
+ * @brief Bump allocator for request-scoped memory.
+ */
+#include "arena.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+/* A chunk chained after the first one */
+struct arena_chunk {
+    struct arena_chunk *next;
+    char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+/**
+ * @brief Initialize an arena.
+ */
+void arena_init(arena_t *arena, void *first, size_t size, size_t min_chunk) {
+    arena->first = first;
+    arena->first_size = size;
+    arena->cur = first;
+    arena->left = size;
+    arena->min_chunk = min_chunk;
+    arena->chunks = NULL;
+}
+/**
+ * @brief Allocate memory aligned to ARENA_ALIGN.
+ */
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size > arena->left) {
+        size_t cap = size > arena->min_chunk ? size : arena->min_chunk;
+        arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + cap);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->cur = chunk->data;
+        arena->left = cap;
+    }
+    void *mem = arena->cur;
+    arena->cur += size;
+    arena->left -= size;
+    return mem;
+}
+/**
+ * @brief Copy len bytes into the arena as a null-terminated string.
+ */
+char *arena_strndup(arena_t *arena, const char *s, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy != NULL) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+/**
+ * @brief Release everything allocated from an arena.
+ */
+void arena_reset(arena_t *arena) {
+    arena_chunk_t *chunk = arena->chunks;
+    while (chunk != NULL) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->cur = arena->first;
+    arena->left = arena->first_size;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file arena.h
+ * @author Xianwei Zou
+ * @brief Bump allocator for request-scoped memory.
+ *
+ * An arena hands out memory from a first chunk given by its owner,
+ * typically a buffer on the stack of a connection thread, and from larger
+ * chunks malloc()ed and chained after it when that is full. Nothing is
+ * freed piecemeal: arena_reset() releases everything at the end of a
+ * request, so a typical request makes no malloc() at all and nothing
+ * allocated from the arena can leak.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+/* Alignment of arena allocations */
+#define ARENA_ALIGN 16
+/* Size of the first chunk of a connection's arena. A cache miss takes about
+ * 24 KB (two rio_t, the headers and the iovecs of the forwarded request),
+ * plus about five copies of the request line (the line, its fields, the
+ * cache key and the parser's fields), so lines up to about 3 KB fit. */
+#define ARENA_CONN_SIZE (40 * 1024)
+/* A chunk chained after the first one */
+typedef struct arena_chunk arena_chunk_t;
+/* A bump allocator */
+typedef struct {
+    char *first;           // first chunk, owned by the caller
+    size_t first_size;     // size of the first chunk
+    char *cur;             // free space of the current chunk
+    size_t left;           // bytes left in the current chunk
+    size_t min_chunk;      // min size of the chained chunks
+    arena_chunk_t *chunks; // chained chunks, newest first
+} arena_t;
+/**
+ * @brief Initialize an arena.
+ *
+ * @param first first chunk, aligned to ARENA_ALIGN
+ * @param size size of the first chunk
+ * @param min_chunk min size of the chunks malloc()ed when it is full
+ */
+void arena_init(arena_t *arena, void *first, size_t size, size_t min_chunk);
+/**
+ * @brief Allocate memory aligned to ARENA_ALIGN, valid until the next
+ * arena_reset().
+ *
+ * @return the memory, or NULL if out of memory
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+/**
+ * @brief Copy len bytes into the arena as a null-terminated string.
+ *
+ * @return the copy, or NULL if out of memory
+ */
+char *arena_strndup(arena_t *arena, const char *s, size_t len);
+/**
+ * @brief Release everything allocated from an arena, which can then be
+ * used again.
+ */
+void arena_reset(arena_t *arena);
+#endif /* ARENA_H */
@@ -0,0 +1,75 @@
+/**
+ * @file parser_bench.c
+ * @author Xianwei Zou
+ * @brief Microbenchmark of the http_parser.h API.
+ *
+ * Parses a browser-like request the way doit() does, plus header lookups
+ * and iteration, and reports the time per request and per line. Built
+ * against the in-tree http_parser.c, and against the reference library
+ * when the Makefile finds it, so that both can be compared.
+ *
+ * Usage: parser-bench [iterations]
+ */
+#include "http_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+/* Lines of the benchmarked request */
+static const char *lines[] = {
+    "GET http://www.example.com:8080/static/js/app.min.js?v=1234 HTTP/1.1\r\n",
+    "Host: www.example.com:8080\r\n",
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:102.0) Gecko/20100101 "
+    "Firefox/102.0\r\n",
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;"
+    "q=0.8\r\n",
+    "Accept-Language: en-US,en;q=0.5\r\n",
+    "Accept-Encoding: gzip, deflate\r\n",
+    "Referer: http://www.example.com:8080/index.html\r\n",
+    "Cookie: session=4f2a9c1e8b7d6a5f3e2d1c0b9a8f7e6d; theme=dark; "
+    "tracking=aGVsbG8gd29ybGQgdGhpcyBpcyBhIGxvbmcgY29va2llIHZhbHVl; "
+    "prefs=eyJsYW5nIjoiZW4iLCJ0eiI6IlVUQyJ9\r\n",
+    "Connection: keep-alive\r\n",
+    "Proxy-Connection: keep-alive\r\n",
+    "Cache-Control: max-age=0\r\n",
+    "Upgrade-Insecure-Requests: 1\r\n",
+};
+#define LINE_CNT (sizeof(lines) / sizeof(lines[0]))
+/**
+ * @brief Get the current time in nanoseconds.
+ */
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    size_t checksum = 0;
+    double start = now_ns();
+    for (long i = 0; i < iterations; i++) {
+        parser_t *p = parser_new();
+        for (size_t l = 0; l < LINE_CNT; l++) {
+            if (parser_parse_line(p, lines[l]) == ERROR) {
+                fprintf(stderr, "%s: cannot parse %s", argv[0], lines[l]);
+                return 1;
+            }
+        }
+        const char *host, *path, *port;
+        parser_retrieve(p, HOST, &host);
+        parser_retrieve(p, PATH, &path);
+        parser_retrieve(p, PORT, &port);
+        checksum += strlen(host) + strlen(path) + strlen(port);
+        header_t *hdr = parser_lookup_header(p, "Cookie");
+        checksum += hdr != NULL ? strlen(hdr->value) : 0;
+        while ((hdr = parser_retrieve_next_header(p)) != NULL) {
+            checksum += hdr->name[0];
+        }
+        parser_free(p);
+    }
+    double elapsed = now_ns() - start;
+    printf("%s: %ld requests, %.1f ns/request, %.1f ns/line (checksum %zu)\n",
+           argv[0], iterations, elapsed / iterations,
+           elapsed / iterations / LINE_CNT, checksum);
+    return 0;
+}
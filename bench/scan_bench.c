@@ -0,0 +1,82 @@
+/**
+ * @file scan_bench.c
+ * @author Xianwei Zou
+ * @brief Microbenchmark of the implementations of scan.h.
+ *
+ * Spans header names and finds delimiters in a request with a large
+ * cookie, with each implementation the CPU supports, and checks that they
+ * all agree with the scalar one.
+ *
+ * Usage: scan-bench [iterations]
+ */
+#include "scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// Size of the benchmarked cookie value
+#define COOKIE_SIZE 4096
+static const char *impl_names[] = {
+    [SCAN_SCALAR] = "scalar", [SCAN_SSE42] = "sse4.2", [SCAN_AVX2] = "avx2"};
+/**
+ * @brief Get the current time in nanoseconds.
+ */
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+/**
+ * @brief Scan the text once: span every header name and find the line ends.
+ *
+ * @return a checksum of the positions found
+ */
+static size_t scan_text(const char *text, const char *end,
+                        const scan_set_t *eol) {
+    size_t checksum = 0;
+    const char *line = text;
+    while (line < end) {
+        const char *name_end = scan_span(line, end, scan_token_set());
+        const char *line_end = scan_find(name_end, end, eol);
+        checksum += (size_t)(name_end - text) * 31 + (size_t)(line_end - text);
+        line = line_end + 1;
+    }
+    return checksum;
+}
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    static char text[COOKIE_SIZE + 1024];
+    char *p = text;
+    p += sprintf(p, "X-Forwarded-For-Client-Address-Long-Name: 10.0.0.1\n"
+                    "Accept-Language: en-US,en;q=0.5\nCookie: ");
+    for (int i = 0; i < COOKIE_SIZE; i++) {
+        *p++ = "abcdefghijklmnopqrstuvwxyz0123456789=; "[i % 39];
+    }
+    p += sprintf(p, "\nConnection: keep-alive\n");
+    const char *end = p;
+    scan_set_t eol;
+    scan_set_init(&eol, "\r\n");
+    scan_use(SCAN_SCALAR);
+    size_t expected = scan_text(text, end, &eol);
+    for (scan_impl_t impl = SCAN_SCALAR; impl <= SCAN_AVX2; impl++) {
+        if (scan_use(impl) != impl) {
+            printf("%s: %s not supported\n", argv[0], impl_names[impl]);
+            continue;
+        }
+        if (scan_text(text, end, &eol) != expected) {
+            fprintf(stderr, "%s: %s disagrees with scalar\n", argv[0],
+                    impl_names[impl]);
+            return 1;
+        }
+        double start = now_ns();
+        size_t checksum = 0;
+        for (long i = 0; i < iterations; i++) {
+            checksum += scan_text(text, end, &eol);
+        }
+        double elapsed = now_ns() - start;
+        printf("%s: %-6s %.1f ns/KB (checksum %zu)\n", argv[0],
+               impl_names[impl], elapsed / iterations / ((end - text) / 1024.0),
+               checksum);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file bufpool.c
+ * @author Xianwei Zou
+ * @brief Pool of fixed-size I/O buffers, borrowed while data is in flight.
+ */
+#include "bufpool.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* An idle buffer, linked through its first bytes */
+typedef struct idle_buf {
+    struct idle_buf *next;
+} idle_buf_t;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t buf_size = 64 * 1024;
+static int idle_max = BUFPOOL_IDLE_MAX;
+static idle_buf_t *idle = NULL; // idle buffers, last returned first
+static int idle_cnt = 0;
+/**
+ * @brief Set the size of the buffers and the max number of idle ones.
+ */
+void bufpool_init(size_t size, int max) {
+    buf_size = size < sizeof(idle_buf_t) ? sizeof(idle_buf_t) : size;
+    idle_max = max;
+}
+/**
+ * @brief Borrow a buffer, the most recently returned one if any, which is
+ * the most likely to still be in the CPU caches.
+ */
+void *bufpool_get(void) {
+    pthread_mutex_lock(&poolLock);
+    idle_buf_t *buf = idle;
+    if (buf != NULL) {
+        idle = buf->next;
+        idle_cnt--;
+    }
+    pthread_mutex_unlock(&poolLock);
+    return buf != NULL ? (void *)buf : malloc(buf_size);
+}
+/**
+ * @brief Return a buffer, which is freed if enough are idle.
+ */
+void bufpool_put(void *buf) {
+    if (buf == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&poolLock);
+    if (idle_cnt < idle_max) {
+        idle_buf_t *node = buf;
+        node->next = idle;
+        idle = node;
+        idle_cnt++;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&poolLock);
+    free(buf);
+}
@@ -0,0 +1,33 @@
+/**
+ * @file bufpool.h
+ * @author Xianwei Zou
+ * @brief Pool of fixed-size I/O buffers, borrowed while data is in flight.
+ *
+ * A connection only needs a large buffer while it relays a response, not
+ * while it waits for a slow client, so the buffers are borrowed from a
+ * shared pool for the relay and returned right after. Returned buffers are
+ * kept on a free list for the next relay, up to a max number of idle ones;
+ * the others are freed, so that idle memory stays bounded however many
+ * connections are open.
+ */
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+#include <stddef.h>
+// Default max number of idle buffers kept by the pool
+#define BUFPOOL_IDLE_MAX 16
+/**
+ * @brief Set the size of the buffers and the max number of idle ones. Must
+ * be called before any buffer is borrowed.
+ */
+void bufpool_init(size_t size, int idle_max);
+/**
+ * @brief Borrow a buffer of the pool's size.
+ *
+ * @return the buffer, or NULL if out of memory
+ */
+void *bufpool_get(void);
+/**
+ * @brief Return a buffer from bufpool_get(). Does nothing on NULL.
+ */
+void bufpool_put(void *buf);
+#endif /* BUFPOOL_H */
@@ -1,6 +1,13 @@
+#include "bufpool.h"
 #include "cache.h"
 #include "csapp.h"
+#include "gzip.h"
 #include "http_parser.h"
+#include "latency.h"
+#include "lockprof.h"
+#include "metrics.h"
+#include "probes.h"
+#include "wheel.h"
 #include <assert.h>
 #include <ctype.h>
 #include <inttypes.h>
@@ -10,6 +17,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 /*
  * Max cache and object sizes
@@ -17,21 +25,491 @@
  */
 #define MAX_CACHE_SIZE (1024 * 1024)
 #define MAX_OBJECT_SIZE (100 * 1024)
-static pthread_mutex_t cacheLock;
+static prof_mutex_t cacheLock;
 size_t total_cache_size;
+static size_t budget_bytes; // max of total_cache_size, see cache_set_budget()
 cache_block_t *head;
+static cache_block_t *buckets[CACHE_BUCKETS]; // blocks chained by key hash
+static cache_body_t *body_buckets[CACHE_BUCKETS]; // bodies chained by digest
+static cache_fill_t *fill_buckets[CACHE_BUCKETS]; // reserved keys, by hash
+static cache_block_t *retired; // blocks to free once cacheLock is released
+static pthread_cond_t evictCond; // over high water, on CLOCK_MONOTONIC
+static wheel_t expiry_wheel;      // expiry timers of blocks, in seconds
+size_t negative_cache_size;
+// TTLs of negatively cached responses, indexed by status - 400
+static int negative_ttl[200] = {[404 - 400] = NEGATIVE_TTL_404,
+                                [410 - 400] = NEGATIVE_TTL_410};
+// Headers added to the cached header block
+static const char *AGE_HEADER = "Age: ";
+static const char *XCACHE_HEADER = "X-Cache: HIT\r\n";
+static const char *GZIP_HEADERS = "Content-Length: %zu\r\n"
+                                  "Content-Encoding: gzip\r\n";
+static const char *VARY_HEADER = "Vary: Accept-Encoding\r\n";
+// Whether compressible bodies are stored gzipped
+static bool gzip_enabled = false;
+// TTL in seconds of responses without a max-age, 0 for none
+static int default_ttl = 0;
+/**
+ * @brief Current time in seconds, from a clock that does not jump.
+ *
+ */
+static time_t cache_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+/**
+ * @brief Parse the status code from the status line of a response.
+ *
+ * @return the status code, or -1 if the response has no valid status line
+ */
+int response_status(const char *body, size_t size) {
+    // "HTTP/x.y NNN"
+    if (size < 12 || strncmp(body, "HTTP/", 5)) {
+        return -1;
+    }
+    const char *code = memchr(body, ' ', size < MAXLINE ? size : MAXLINE);
+    if (code == NULL || (size_t)(code - body) + 4 > size) {
+        return -1;
+    }
+    if (!isdigit((unsigned char)code[1]) || !isdigit((unsigned char)code[2]) ||
+        !isdigit((unsigned char)code[3])) {
+        return -1;
+    }
+    return (code[1] - '0') * 100 + (code[2] - '0') * 10 + (code[3] - '0');
+}
+/**
+ * @brief Find the end of the header block of a response.
+ *
+ * @param from offset to start searching from
+ * @return length of the header block including the empty line,
+ * or 0 if the response has no complete header block
+ */
+size_t header_length(const char *resp, size_t from, size_t size) {
+    for (size_t i = from; i < size; i++) {
+        if (resp[i] != '\n') {
+            continue;
+        }
+        if (i + 1 < size && resp[i + 1] == '\n') {
+            return i + 2;
+        }
+        if (i + 2 < size && resp[i + 1] == '\r' && resp[i + 2] == '\n') {
+            return i + 3;
+        }
+    }
+    return 0;
+}
+/**
+ * @brief Find the value of a header in a header block.
+ *
+ * @param[out] len length of the value, without surrounding whitespace
+ * @return the value, or NULL if the header is missing
+ */
+const char *header_value(const char *resp, size_t hdr_len, const char *name,
+                         size_t *len) {
+    size_t name_len = strlen(name);
+    const char *line = resp;
+    const char *end = resp + hdr_len;
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) {
+            break;
+        }
+        if ((size_t)(eol - line) > name_len && line[name_len] == ':' &&
+            !strncasecmp(line, name, name_len)) {
+            const char *value = line + name_len + 1;
+            while (value < eol && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            const char *value_end = eol;
+            while (value_end > value && isspace((unsigned char)value_end[-1])) {
+                value_end--;
+            }
+            *len = value_end - value;
+            return value;
+        }
+        line = eol + 1;
+    }
+    return NULL;
+}
+/**
+ * @brief Get the freshness lifetime of a response from its Cache-Control
+ * header, s-maxage taking precedence over max-age as in shared caches.
+ *
+ * @return the lifetime in seconds, or -1 if the header gives none
+ */
+static long response_max_age(const char *resp, size_t hdr_len) {
+    size_t len;
+    const char *value = header_value(resp, hdr_len, "Cache-Control", &len);
+    if (value == NULL) {
+        return -1;
+    }
+    long max_age = -1;
+    const char *end = value + len;
+    const char *p = value;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        const char *directive = p;
+        while (p < end && *p != ',') {
+            p++;
+        }
+        // the digits are followed by ',' or the end of the line
+        size_t directive_len = p - directive;
+        if (directive_len > 9 && !strncasecmp(directive, "s-maxage=", 9)) {
+            return strtol(directive + 9, NULL, 10);
+        }
+        if (directive_len > 8 && !strncasecmp(directive, "max-age=", 8)) {
+            max_age = strtol(directive + 8, NULL, 10);
+        }
+    }
+    return max_age;
+}
+/**
+ * @brief Check if an origin header line is replaced in cached header blocks.
+ */
+static bool header_dropped(const char *line, bool drop_length) {
+    return !strncasecmp(line, "Age:", 4) || !strncasecmp(line, "X-Cache:", 8) ||
+           (drop_length && !strncasecmp(line, "Content-Length:", 15));
+}
+/**
+ * @brief Pre-render a header block sent on cache hits.
+ * The origin's Age and X-Cache headers are replaced with our own; the
+ * Age value is left as AGE_WIDTH zeros and patched on every hit.
+ *
+ * @param header receives the rendered block
+ * @param resp response from the origin
+ * @param hdr_len length of its header block, including the empty line
+ * @param extra extra header lines to add, may be empty
+ * @param drop_length whether to drop the origin's Content-Length
+ * @return false if out of memory
+ */
+static bool render_header(cache_header_t *header, const char *resp,
+                          size_t hdr_len, const char *extra,
+                          bool drop_length) {
+    size_t age_len = strlen(AGE_HEADER);
+    size_t xcache_len = strlen(XCACHE_HEADER);
+    size_t extra_len = strlen(extra);
+    char *data =
+        malloc(hdr_len + age_len + AGE_WIDTH + 2 + xcache_len + extra_len);
+    if (data == NULL) {
+        return false;
+    }
+    size_t len = 0;
+    const char *line = resp;
+    const char *end = resp + hdr_len;
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line) + 1;
+        bool blank = line[0] == '\n' || (line[0] == '\r' && line[1] == '\n');
+        if (blank) {
+            // our headers go right before the empty line
+            memcpy(data + len, extra, extra_len);
+            len += extra_len;
+            memcpy(data + len, AGE_HEADER, age_len);
+            len += age_len;
+            header->age_off = len;
+            memset(data + len, '0', AGE_WIDTH);
+            len += AGE_WIDTH;
+            memcpy(data + len, "\r\n", 2);
+            len += 2;
+            memcpy(data + len, XCACHE_HEADER, xcache_len);
+            len += xcache_len;
+        } else if (line != resp && header_dropped(line, drop_length)) {
+            line = eol;
+            continue;
+        }
+        memcpy(data + len, line, eol - line);
+        len += eol - line;
+        line = eol;
+    }
+    header->data = data;
+    header->len = len;
+    return true;
+}
+/**
+ * @brief Create a body, gzipping it if compress is set and worth it.
+ *
+ * @return the body with one reference, or NULL if out of memory
+ */
+static cache_body_t *body_new(const char *data, size_t len, bool compress,
+                              const uint64_t digest[2]) {
+    cache_body_t *body = (cache_body_t *)calloc(1, sizeof(cache_body_t));
+    if (body == NULL) {
+        return NULL;
+    }
+    body->digest[0] = digest[0];
+    body->digest[1] = digest[1];
+    body->refcnt = 1;
+    body->plain_len = len;
+    body->data = compress ? gzip_deflate(data, len, &body->len) : NULL;
+    if (body->data != NULL) {
+        body->gzipped = true;
+    } else {
+        body->len = len;
+        body->data = malloc(len > 0 ? len : 1);
+        if (body->data == NULL) {
+            free(body);
+            return NULL;
+        }
+        memcpy(body->data, data, len); // copy body
+    }
+    body->alloc = body->data;
+    return body;
+}
+/**
+ * @brief Create a body from the storage of a filled response in place,
+ * without copying it. The storage is shrunk to the response, which may
+ * move it.
+ *
+ * @param resp the response, updated if it moved
+ * @return the body with one reference, or NULL if out of memory
+ */
+static cache_body_t *body_adopt(char **resp, size_t size, size_t hdr_len,
+                                const uint64_t digest[2]) {
+    cache_body_t *body = (cache_body_t *)calloc(1, sizeof(cache_body_t));
+    if (body == NULL) {
+        return NULL;
+    }
+    char *shrunk = realloc(*resp, size > 0 ? size : 1);
+    if (shrunk != NULL) {
+        *resp = shrunk;
+    }
+    body->digest[0] = digest[0];
+    body->digest[1] = digest[1];
+    body->refcnt = 1;
+    body->alloc = *resp;
+    body->data = *resp + hdr_len;
+    body->len = size - hdr_len;
+    body->plain_len = body->len;
+    return body;
+}
+/**
+ * @brief Drop a reference to a body, freeing it with the last one.
+ * cacheLock must be held for shared bodies.
+ */
+static void body_release(cache_body_t *body) {
+    body->refcnt = body->refcnt - 1;
+    if (body->refcnt == 0) {
+        free(body->alloc);
+        free(body);
+    }
+}
+/**
+ * @brief Check if a body holds exactly the given plain bytes. The body
+ * is immutable, so a reference is enough to compare it without the lock.
+ */
+static bool body_equal(const cache_body_t *body, const char *data,
+                       size_t len) {
+    if (body->plain_len != len) {
+        return false;
+    }
+    if (body->gzipped) {
+        return gzip_inflate_equal(body->data, body->len, data, len);
+    }
+    return !memcmp(body->data, data, len);
+}
+/**
+ * @brief Find a body in the body table by digest. A match is only a
+ * candidate: the hash is not collision-resistant, so the bytes must be
+ * compared with body_equal() before the body is shared.
+ */
+static cache_body_t *body_find(const uint64_t digest[2]) {
+    cache_body_t *tmp;
+    for (tmp = body_buckets[digest[0] % CACHE_BUCKETS]; tmp != NULL;
+         tmp = tmp->hnext) {
+        if (tmp->digest[0] == digest[0] && tmp->digest[1] == digest[1]) {
+            return tmp;
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief Account for a block pointing to a body that is being cached.
+ * The body joins the body table unless a body with the same digest is
+ * already there (a concurrent insert or a collision), in which case it
+ * stays private to its block.
+ */
+static void body_link(cache_body_t *body) {
+    if (!body->shared && body_find(body->digest) == NULL) {
+        cache_body_t **bucket = &body_buckets[body->digest[0] % CACHE_BUCKETS];
+        body->hnext = *bucket;
+        *bucket = body;
+        body->shared = true;
+        total_cache_size = total_cache_size + body->len;
+    }
+    if (body->shared) {
+        body->linked = body->linked + 1;
+    }
+}
+/**
+ * @brief Account for a block pointing to a body leaving the cache.
+ * The body leaves the body table with the last such block.
+ */
+static void body_unlink(cache_body_t *body) {
+    if (!body->shared) {
+        return;
+    }
+    body->linked = body->linked - 1;
+    if (body->linked > 0) {
+        return;
+    }
+    cache_body_t **link = &body_buckets[body->digest[0] % CACHE_BUCKETS];
+    while (*link != body) {
+        link = &(*link)->hnext;
+    }
+    *link = body->hnext;
+    body->shared = false;
+    total_cache_size = total_cache_size - body->len;
+}
+/**
+ * @brief Render the header blocks of a new block for its body.
+ * Gzipped bodies get both a plain and a gzip header block.
+ *
+ * @return false if out of memory
+ */
+static bool render_headers(cache_block_t *block, const char *resp,
+                           size_t hdr_len) {
+    cache_body_t *body = block->body;
+    if (hdr_len == 0) {
+        return true;
+    }
+    if (!body->gzipped) {
+        return render_header(&block->header, resp, hdr_len, "", false);
+    }
+    char extra[MAXLINE];
+    snprintf(extra, sizeof(extra), GZIP_HEADERS, body->len);
+    strcat(extra, VARY_HEADER);
+    if (!render_header(&block->header, resp, hdr_len, VARY_HEADER, false)) {
+        return false;
+    }
+    return render_header(&block->gzip_header, resp, hdr_len, extra, true);
+}
+/**
+ * @brief Check if the body of a response should be stored gzipped.
+ */
+static bool body_compressible(const char *resp, size_t size, size_t hdr_len) {
+    size_t type_len, coding_len;
+    const char *type = header_value(resp, hdr_len, "Content-Type", &type_len);
+    return gzip_enabled && hdr_len > 0 && size - hdr_len >= GZIP_MIN_SIZE &&
+           type != NULL && gzip_compressible(type, type_len) &&
+           header_value(resp, hdr_len, "Content-Encoding", &coding_len) ==
+               NULL;
+}
+/**
+ * @brief Start hashing the body of a response.
+ */
+void cache_digest_init(cache_digest_t *digest) {
+    digest->hdr_len = 0;
+    digest->scanned = 0;
+    hash128_init(&digest->body_hash);
+}
+/**
+ * @brief Hash the bytes of a response received since the last update.
+ */
+void cache_digest_update(cache_digest_t *digest, const char *resp,
+                         size_t len) {
+    size_t from = digest->scanned;
+    if (digest->hdr_len == 0) {
+        // the empty line may start in the previous chunk
+        size_t start = from > 2 ? from - 2 : 0;
+        digest->hdr_len = header_length(resp, start, len);
+        if (digest->hdr_len == 0) {
+            digest->scanned = len;
+            return;
+        }
+        from = digest->hdr_len;
+    }
+    hash128_update(&digest->body_hash, resp + from, len - from);
+    digest->scanned = len;
+}
+/**
+ * @brief Describe a header block as iovecs, patching in the Age value.
+ *
+ * @return the number of iovecs used
+ */
+static int header_iov(cache_header_t *header, time_t stored,
+                      struct iovec *iov, char *age) {
+    if (header->len == 0) {
+        return 0;
+    }
+    // patch the fixed-width Age value, without formatting
+    time_t secs = cache_now() - stored;
+    for (int i = AGE_WIDTH - 1; i >= 0; i--) {
+        age[i] = (char)('0' + secs % 10);
+        secs /= 10;
+    }
+    if (secs > 0) {
+        memset(age, '9', AGE_WIDTH);
+    }
+    iov[0].iov_base = header->data;
+    iov[0].iov_len = header->age_off;
+    iov[1].iov_base = age;
+    iov[1].iov_len = AGE_WIDTH;
+    iov[2].iov_base = header->data + header->age_off + AGE_WIDTH;
+    iov[2].iov_len = header->len - header->age_off - AGE_WIDTH;
+    return 3;
+}
+/**
+ * @brief Describe the response of a cached block as an iovec array.
+ */
+int cache_block_iov(cache_block_t *block, struct iovec *iov, char *age,
+                    bool gzip) {
+    cache_header_t *header = gzip ? &block->gzip_header : &block->header;
+    int cnt = header_iov(header, block->stored, iov, age);
+    iov[cnt].iov_base = block->body->data;
+    iov[cnt++].iov_len = block->body->len;
+    return cnt;
+}
+/**
+ * @brief Enable or disable gzip storage of compressible bodies.
+ */
+void cache_set_gzip(bool enable) {
+    gzip_enabled = enable;
+}
+/**
+ * @brief Set the TTL of responses that do not give their own.
+ */
+void cache_set_default_ttl(int ttl) {
+    default_ttl = ttl;
+}
+/**
+ * @brief Set the TTL of negatively cached responses with a given status.
+ */
+int cache_set_negative_ttl(int status, int ttl) {
+    if (status < 400 || status > 599 || ttl < 0) {
+        return -1;
+    }
+    negative_ttl[status - 400] = ttl;
+    return 0;
+}
 /**
  * @brief Inintialize the cache linked list
  *
  */
 void cache_init() {
     total_cache_size = 0;
+    budget_bytes = MAX_CACHE_SIZE;
+    negative_cache_size = 0;
     head = NULL;
+    memset(buckets, 0, sizeof(buckets));
+    memset(body_buckets, 0, sizeof(body_buckets));
+    memset(fill_buckets, 0, sizeof(fill_buckets));
+    retired = NULL;
     // Initialize the cache lock
-    pthread_mutex_init(&cacheLock, NULL);
+    prof_mutex_init(&cacheLock, "cache");
+    // the evictor waits for the ticks of the expiry wheel on cache_now()'s
+    // clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&evictCond, &attr);
+    pthread_condattr_destroy(&attr);
+    wheel_init(&expiry_wheel, cache_now());
 }
 /**
- * @brief Free the cache linked list.
+ * @brief Free a block and drop its reference to its body.
+ * cacheLock must be held, unless the block was retired.
  *
  * @param block
  */
@@ -40,20 +518,61 @@ void cache_block_free(cache_block_t *block) {
         return;
     } else {
         free(block->url);
-        free(block->body);
+        free(block->header.data);
+        free(block->gzip_header.data);
+        if (block->body != NULL) {
+            body_release(block->body);
+        }
         free(block);
     }
     return;
 }
+/**
+ * @brief Queue a block that is no longer used to be freed by
+ * cache_unlock(). A shared body loses its reference now, so that only
+ * memory nothing else points to is freed outside of the lock.
+ * cacheLock must be held.
+ */
+static void block_retire(cache_block_t *block) {
+    cache_body_t *body = block->body;
+    if (body != NULL && body->refcnt > 1) {
+        body->refcnt = body->refcnt - 1;
+        block->body = NULL;
+    }
+    block->next = retired;
+    retired = block;
+}
+/**
+ * @brief Release cacheLock, then free the blocks retired while it was
+ * held, so that other threads do not wait for free().
+ */
+static void cache_unlock() {
+    cache_block_t *block = retired;
+    retired = NULL;
+    prof_mutex_unlock(&cacheLock);
+    while (block != NULL) {
+        cache_block_t *next = block->next;
+        cache_block_free(block);
+        block = next;
+    }
+}
 /**
  * @brief Inert a block into cache linked list
  *
  * @param block
  */
 void insert_head(cache_block_t *block) {
+    // Chain into its hash bucket
+    cache_block_t **bucket = &buckets[block->hash % CACHE_BUCKETS];
+    block->hnext = *bucket;
+    *bucket = block;
+    if (block->negative) {
+        negative_cache_size = negative_cache_size + block->size;
+    } else {
+        total_cache_size = total_cache_size + block->size;
+    }
     // Check empty
     if (head == NULL) {
-        total_cache_size = total_cache_size + block->size;
         head = block;
         block->prev = NULL;
         block->next = NULL;
@@ -65,38 +584,282 @@ void insert_head(cache_block_t *block) {
     head = block;
     block->next = tmp;
     block->prev = NULL;
-    total_cache_size = total_cache_size + block->size;
+    tmp->prev = block;
     return;
 }
 /**
- * @brief Insert a new data into cache.
+ * @brief Find the fill that reserved a key. cacheLock must be held.
  */
-void cache_insert(char *url, char *body, size_t size) {
-    pthread_mutex_lock(&cacheLock);
-    increase_time();
-    if (cache_block_find(url) != NULL) {
-        pthread_mutex_unlock(&cacheLock);
+static cache_fill_t *fill_find(const char *url, uint64_t hash) {
+    cache_fill_t *tmp;
+    for (tmp = fill_buckets[hash % CACHE_BUCKETS]; tmp != NULL;
+         tmp = tmp->next) {
+        if (tmp->hash == hash && !strcmp(tmp->url, url)) {
+            return tmp;
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief Release the key reserved by a fill. cacheLock must be held.
+ */
+static void fill_unlink(cache_fill_t *fill) {
+    if (fill->url == NULL) {
         return;
     }
-    cache_block_t *new_block = (cache_block_t *)malloc(sizeof(cache_block_t));
-    char *bodycpy = (char *)malloc(size);
-    memcpy(bodycpy, body, size); // copy body
-    new_block->body = bodycpy;
-    char *urlcpy = (char *)malloc(strlen(url) + 1);
+    cache_fill_t **link = &fill_buckets[fill->hash % CACHE_BUCKETS];
+    while (*link != fill) {
+        link = &(*link)->next;
+    }
+    *link = fill->next;
+    fill->url = NULL;
+}
+/**
+ * @brief Insert a response into the cache. The response of a fill has its
+ * storage adopted as the body if the body is stored as is, and its key
+ * released once the block is in.
+ *
+ * @param fill the fill of the response, or NULL to copy it
+ * @return true if the storage was adopted, false if it is still the
+ * caller's
+ */
+static bool cache_store(const char *url, uint64_t hash, char *body,
+                        size_t size, cache_digest_t *digest,
+                        cache_fill_t *fill) {
+    // Only successful responses and errors with a TTL are cached
+    int status = response_status(body, size);
+    bool negative = status >= 400;
+    long ttl = 0;
+    if (status > 599) {
+        return false;
+    } else if (negative) {
+        ttl = negative_ttl[status - 400];
+        if (ttl == 0 || size > MAX_NEGATIVE_CACHE_SIZE) {
+            return false;
+        }
+    }
+    size_t hdr_len = status < 0 ? 0 : header_length(body, 0, size);
+    // Other responses expire after their max-age, or the default TTL
+    if (!negative) {
+        long max_age = hdr_len > 0 ? response_max_age(body, hdr_len) : -1;
+        if (max_age == 0) {
+            return false; // stale as soon as stored
+        }
+        ttl = max_age > 0 ? max_age : default_ttl;
+    }
+    // Hash of the body, computed while relaying when possible
+    uint64_t body_digest[2];
+    if (digest != NULL && digest->hdr_len == hdr_len &&
+        digest->scanned == size) {
+        hash128_final(&digest->body_hash, body_digest);
+    } else {
+        hash128_t body_hash;
+        hash128_init(&body_hash);
+        hash128_update(&body_hash, body + hdr_len, size - hdr_len);
+        hash128_final(&body_hash, body_digest);
+    }
+    cache_block_t *new_block =
+        (cache_block_t *)calloc(1, sizeof(cache_block_t));
+    if (new_block == NULL) {
+        return false;
+    }
+    // Share the body of an identical response that is already cached;
+    // negative blocks keep private bodies in their own budget
+    if (!negative) {
+        prof_mutex_lock(&cacheLock);
+        new_block->body = body_find(body_digest);
+        if (new_block->body != NULL) {
+            new_block->body->refcnt = new_block->body->refcnt + 1;
+        }
+        prof_mutex_unlock(&cacheLock);
+    }
+    // Only share a body with the same bytes, compared outside the lock:
+    // a body crafted to collide must not be served under another URL
+    if (new_block->body != NULL &&
+        !body_equal(new_block->body, body + hdr_len, size - hdr_len)) {
+        prof_mutex_lock(&cacheLock);
+        body_release(new_block->body);
+        prof_mutex_unlock(&cacheLock);
+        new_block->body = NULL;
+    }
+    // Render the block outside of the lock
+    bool adopted = false;
+    if (new_block->body == NULL) {
+        bool compress = body_compressible(body, size, hdr_len);
+        if (fill != NULL && !compress) {
+            new_block->body = body_adopt(&body, size, hdr_len, body_digest);
+            adopted = new_block->body != NULL;
+        } else {
+            new_block->body =
+                body_new(body + hdr_len, size - hdr_len, compress, body_digest);
+        }
+    }
+    char *urlcpy = NULL;
+    if (new_block->body == NULL ||
+        !render_headers(new_block, body, hdr_len) ||
+        (urlcpy = (char *)malloc(strlen(url) + 1)) == NULL) {
+        prof_mutex_lock(&cacheLock);
+        cache_block_free(new_block); // frees an adopted body too
+        prof_mutex_unlock(&cacheLock);
+        return adopted;
+    }
     strcpy(urlcpy, url); // copy url
     new_block->url = urlcpy;
+    new_block->hash = hash;
     new_block->LRU_cnt = 0;
     new_block->thread_cnt = 1;
-    new_block->size = size;
+    new_block->status = status;
+    new_block->negative = negative;
+    new_block->stored = cache_now();
+    new_block->expires = ttl > 0 ? new_block->stored + ttl : 0;
+    wheel_timer_init(&new_block->timer);
     new_block->next = NULL;
     new_block->prev = NULL;
+    new_block->hnext = NULL;
+    prof_mutex_lock(&cacheLock);
+    if (fill == NULL) {
+        increase_time(); // a fill was looked up by cache_acquire()
+    } else {
+        fill_unlink(fill);
+    }
+    if (cache_block_find(url, hash) != NULL) {
+        cache_block_free(new_block);
+        prof_mutex_unlock(&cacheLock);
+        return adopted;
+    }
+    if (!negative) {
+        body_link(new_block->body);
+    }
+    new_block->size = new_block->header.len + new_block->gzip_header.len;
+    if (!new_block->body->shared) {
+        new_block->size = new_block->size + new_block->body->len;
+    }
     // Check full
     // Cache is full, need to remove block
-    if (total_cache_size + new_block->size > MAX_CACHE_SIZE) {
-        cache_block_evict(new_block->size);
+    if (negative) {
+        cache_negative_evict(new_block->size);
     }
     insert_head(new_block); // cache the body into block
-    pthread_mutex_unlock(&cacheLock);
+    if (new_block->expires != 0) {
+        wheel_add(&expiry_wheel, &new_block->timer, new_block->expires);
+    }
+    PROBE_CACHE_INSERT(new_block->url, size);
+    // evicted inline only if the evictor has fallen behind
+    if (total_cache_size > budget_bytes) {
+        cache_block_evict(0);
+    }
+    if (total_cache_size > CACHE_HIGH_WATER(budget_bytes)) {
+        pthread_cond_signal(&evictCond);
+    }
+    cache_unlock();
+    return adopted;
+}
+/**
+ * @brief Insert a new data into cache.
+ */
+void cache_insert(const char *url, uint64_t hash, char *body, size_t size,
+                  cache_digest_t *digest) {
+    cache_store(url, hash, body, size, digest, NULL);
+}
+/**
+ * @brief Reserve storage for a response about to be relayed.
+ */
+bool cache_fill_reserve(cache_fill_t *fill) {
+    fill->data = bufpool_get();
+    fill->len = 0;
+    cache_digest_init(&fill->digest);
+    fill->url = NULL;
+    fill->next = NULL;
+    return fill->data != NULL;
+}
+/**
+ * @brief Account for n bytes written at data + len.
+ */
+void cache_fill_append(cache_fill_t *fill, size_t n) {
+    fill->len += n;
+    if (fill->len <= MAX_OBJECT_SIZE) {
+        cache_digest_update(&fill->digest, fill->data, fill->len);
+    }
+}
+/**
+ * @brief Insert a filled response under its reserved key, adopting its
+ * storage.
+ */
+void cache_fill_commit(cache_fill_t *fill) {
+    if (fill->url != NULL && fill->len <= MAX_OBJECT_SIZE &&
+        cache_store(fill->url, fill->hash, fill->data, fill->len,
+                    &fill->digest, fill)) {
+        fill->data = NULL; // now owned by the cached body
+    }
+    cache_fill_abort(fill);
+}
+/**
+ * @brief Release the storage of a response that is not cached, and its
+ * key if still reserved.
+ */
+void cache_fill_abort(cache_fill_t *fill) {
+    if (fill->url != NULL) {
+        prof_mutex_lock(&cacheLock);
+        fill_unlink(fill);
+        prof_mutex_unlock(&cacheLock);
+    }
+    bufpool_put(fill->data);
+    fill->data = NULL;
+}
+/**
+ * @brief Unlink a block from the cache. cacheLock must be held. Unless it
+ * is still being sent, the block is retired and only freed by
+ * cache_unlock(), after the lock is released.
+ *
+ * @param block
+ */
+void cache_block_remove(cache_block_t *block) {
+    // remove the block from the web cache list, in O(1) by its links
+    cache_block_t *prev_block = block->prev;
+    cache_block_t *next_block = block->next;
+    if (prev_block == NULL) { // if head
+        head = next_block;
+    } else { // not head
+        prev_block->next = next_block;
+    }
+    if (next_block != NULL) {
+        next_block->prev = prev_block;
+    }
+    block->next = NULL;
+    block->prev = NULL;
+    wheel_del(&block->timer);
+    // remove the block from its hash bucket
+    cache_block_t **link = &buckets[block->hash % CACHE_BUCKETS];
+    while (*link != block) {
+        link = &(*link)->hnext;
+    }
+    *link = block->hnext;
+    if (block->negative) {
+        negative_cache_size = negative_cache_size - block->size;
+    } else {
+        total_cache_size = total_cache_size - block->size;
+        body_unlink(block->body);
+    }
+    block->thread_cnt = block->thread_cnt - 1;
+    // Free block, unless it is still being sent
+    if (block->thread_cnt == 0) {
+        block_retire(block);
+    }
+}
+/**
+ * @brief Remove the least recently used block. cacheLock must be held.
+ *
+ * @return false if there is no block to remove
+ */
+static bool evict_lru() {
+    cache_block_t *LRU_block = LRU_get();
+    if (LRU_block == NULL) {
+        return false;
+    }
+    PROBE_CACHE_EVICT(LRU_block->url, LRU_block->size);
+    cache_block_remove(LRU_block);
+    metrics_add(METRIC_EVICTIONS, 1);
+    return true;
 }
 /**
  * @brief Remove the block that content has not been used for the
@@ -105,42 +868,85 @@ void cache_insert(char *url, char *body, size_t size) {
  * @param size
  */
 void cache_block_evict(size_t size) {
+    while (total_cache_size + size > budget_bytes && evict_lru()) {
+    }
+}
+/**
+ * @brief Remove the blocks that have expired. cacheLock must be held.
+ */
+static void expire_blocks() {
+    wheel_timer_t *timer = wheel_advance(&expiry_wheel, cache_now());
+    while (timer != NULL) {
+        wheel_timer_t *next = timer->next;
+        cache_block_t *block = wheel_entry(timer, cache_block_t, timer);
+        PROBE_CACHE_EVICT(block->url, block->size);
+        cache_block_remove(block);
+        metrics_add(METRIC_EXPIRATIONS, 1);
+        timer = next;
+    }
+}
+/**
+ * @brief Evictor thread. At each tick of the expiry wheel, it removes the
+ * blocks that have expired. Whenever the cache grows past the high
+ * watermark, it evicts least recently used blocks down to the low one,
+ * one block per hold of the lock so that requests are not held up.
+ */
+static void *evictor(void *vargp) {
+    pthread_detach(pthread_self());
     while (true) {
-        if (total_cache_size + size <= MAX_CACHE_SIZE) {
-            break;
+        prof_mutex_lock(&cacheLock);
+        if (total_cache_size <= CACHE_HIGH_WATER(budget_bytes)) {
+            struct timespec tick = {.tv_sec = expiry_wheel.now + 1};
+            prof_cond_timedwait(&evictCond, &cacheLock, &tick);
+        }
+        expire_blocks();
+        if (total_cache_size > CACHE_HIGH_WATER(budget_bytes)) {
+            while (total_cache_size > CACHE_LOW_WATER(budget_bytes) &&
+                   evict_lru()) {
+                cache_unlock(); // frees the evicted block
+                prof_mutex_lock(&cacheLock);
+            }
         }
-        cache_block_t *LRU_block = LRU_get();
-        cache_block_t *prev_block = NULL;
-        // find the previous web obejct of LRU_block
+        cache_unlock();
+    }
+    return NULL;
+}
+/**
+ * @brief Start the evictor thread.
+ */
+int cache_evictor_start() {
+    pthread_t tid;
+    return pthread_create(&tid, NULL, evictor, NULL) != 0 ? -1 : 0;
+}
+/**
+ * @brief Make room in the negative budget, removing expired blocks first
+ * and then the least recently used negative blocks.
+ *
+ * @param size
+ */
+void cache_negative_evict(size_t size) {
+    time_t now = cache_now();
+    while (negative_cache_size + size > MAX_NEGATIVE_CACHE_SIZE) {
+        cache_block_t *victim = NULL;
         cache_block_t *tmp;
-        // if not head
-        int not_equal = strcmp(head->url, LRU_block->url);
-        if (not_equal) {
-            for (tmp = head; tmp != NULL; tmp = tmp->next) {
-                int found = !strcmp(tmp->next->url, LRU_block->url);
-                if (found) {
-                    prev_block = tmp;
-                    break;
-                }
+        for (tmp = head; tmp != NULL; tmp = tmp->next) {
+            if (!tmp->negative) {
+                continue;
+            }
+            if (tmp->expires <= now) {
+                victim = tmp;
+                break;
+            }
+            if (victim == NULL || victim->LRU_cnt <= tmp->LRU_cnt) {
+                victim = tmp;
             }
-        } else { // head
-            prev_block = NULL;
         }
-        // find the next web object of LRU_block
-        cache_block_t *next_block = LRU_block->next;
-        // remove the LRU_block from the web cache list
-        // if head
-        if (prev_block == NULL) {
-            head = next_block;
-            LRU_block->next = NULL;
-        } else { // not head
-            prev_block->next = next_block;
-            LRU_block->next = NULL;
+        if (victim == NULL) {
+            break;
         }
-        total_cache_size = total_cache_size - LRU_block->size;
-        LRU_block->thread_cnt = LRU_block->thread_cnt - 1;
-        // Free block
-        cache_block_free(LRU_block);
+        PROBE_CACHE_EVICT(victim->url, victim->size);
+        cache_block_remove(victim);
+        metrics_add(METRIC_EVICTIONS, 1);
     }
 }
 /**
@@ -155,7 +961,8 @@ void increase_time() {
 }
 /**
  * @brief Get the least recent use block.
- * The block that has the largest LRU_cnt value.
+ * The block that has the largest LRU_cnt value, among the blocks
+ * that are not negatively cached.
  */
 cache_block_t *LRU_get() {
     // check empty
@@ -164,10 +971,11 @@ cache_block_t *LRU_get() {
     }
 
     int max_cnt = 0;
-    cache_block_t *max = head;
+    cache_block_t *max = NULL;
     cache_block_t *tmp;
     for (tmp = head; tmp != NULL; tmp = tmp->next) {
-        if (max_cnt <= tmp->LRU_cnt) {
+        // negative blocks have their own budget
+        if (!tmp->negative && max_cnt <= tmp->LRU_cnt) {
             max_cnt = tmp->LRU_cnt;
             max = tmp;
         }
@@ -175,40 +983,158 @@ cache_block_t *LRU_get() {
     return max;
 }
 /**
- * @brief Sent data directly to client if it is in the cache.
- *
- * @return false if not found in cache
+ * @brief Look up a key and, on a miss, reserve it for the caller.
  */
-bool cache_check(int fd, char *url) {
-    pthread_mutex_lock(&cacheLock);
+cache_result_t cache_acquire(const char *url, uint64_t hash,
+                             cache_block_t **block, cache_fill_t *fill) {
+    uint64_t start = latency_now();
+    prof_mutex_lock(&cacheLock);
     increase_time();
-    cache_block_t *block = cache_block_find(url);
+    cache_block_t *found = cache_block_find(url, hash);
+    // expired block not reaped yet, fetch it again
+    if (found != NULL && found->expires != 0 &&
+        found->expires <= cache_now()) {
+        cache_block_remove(found);
+        found = NULL;
+    }
+    latency_record(PHASE_CACHE_LOOKUP, start);
     // found in the cache
-    if (block != NULL) {
-        block->thread_cnt = block->thread_cnt + 1;
-        block->LRU_cnt = 0; // use, update time
-        pthread_mutex_unlock(&cacheLock);
-        rio_writen(fd, block->body, block->size); // send directly to client
-        block->thread_cnt = block->thread_cnt - 1;
-        return true;
-    } else { // not found
-        pthread_mutex_unlock(&cacheLock);
-        return false;
+    if (found != NULL) {
+        found->thread_cnt = found->thread_cnt + 1;
+        found->LRU_cnt = 0; // use, update time
+        PROBE_CACHE_HIT(found->url, found->body->len);
+        cache_unlock();
+        *block = found;
+        return CACHE_HIT;
+    }
+    // another request is already relaying it into the cache
+    if (fill_find(url, hash) != NULL) {
+        cache_unlock();
+        return CACHE_FILLING;
     }
+    fill->url = url;
+    fill->hash = hash;
+    cache_fill_t **bucket = &fill_buckets[hash % CACHE_BUCKETS];
+    fill->next = *bucket;
+    *bucket = fill;
+    cache_unlock();
+    // the storage is borrowed outside of the lock
+    fill->data = bufpool_get();
+    fill->len = 0;
+    cache_digest_init(&fill->digest);
+    if (fill->data == NULL) {
+        cache_fill_abort(fill);
+        return CACHE_FILLING;
+    }
+    return CACHE_MISS;
+}
+/**
+ * @brief Release a block from cache_acquire() without sending it.
+ */
+void cache_release(cache_block_t *block) {
+    // the block may have been evicted while it was held
+    prof_mutex_lock(&cacheLock);
+    block->thread_cnt = block->thread_cnt - 1;
+    if (block->thread_cnt == 0) {
+        block_retire(block);
+    }
+    cache_unlock();
+}
+/**
+ * @brief Send a block from cache_acquire() to a client and release it.
+ */
+bool cache_send(int fd, cache_block_t *block, bool accept_gzip) {
+    struct iovec iov[CACHE_IOV_CNT];
+    char age[AGE_WIDTH];
+    cache_body_t *body = block->body;
+    ssize_t sent;
+    if (body->gzipped && !accept_gzip) {
+        // send the plain header, then inflate the body on the fly; the
+        // header goes out with the first inflated chunk
+        int iovcnt = header_iov(&block->header, block->stored, iov, age);
+        rio_out_t out;
+        rio_outinitb(&out, fd);
+        sent = 0;
+        for (int i = 0; i < iovcnt && sent >= 0; i++) {
+            if (rio_writeb(&out, iov[i].iov_base, iov[i].iov_len) < 0) {
+                sent = -1;
+            } else {
+                sent += (ssize_t)iov[i].iov_len;
+            }
+        }
+        if (sent >= 0) {
+            ssize_t inflated = gzip_inflate_writeb(&out, body->data, body->len);
+            if (inflated < 0 || rio_flushb(&out) < 0) {
+                sent = -1;
+            } else {
+                sent += inflated;
+            }
+        }
+    } else {
+        int iovcnt = cache_block_iov(block, iov, age, body->gzipped);
+        sent = rio_writevn(fd, iov, iovcnt); // send directly to client
+    }
+    if (sent >= 0) {
+        metrics_add(METRIC_BYTES_OUT, sent);
+    } else {
+        metrics_add(METRIC_ERR_CLIENT_WRITE, 1);
+    }
+    cache_release(block);
+    return sent >= 0;
 }
 /**
  * @brief Find if the url content is in the cache.
  * If not, return NULL. If in the cache, return the block.
  *
- * @param url
+ * @param url canonical key
+ * @param hash hash of the key
  */
-cache_block_t *cache_block_find(char *url) {
-    cache_block_t *tmp = head;
-    for (tmp = head; tmp != NULL; tmp = tmp->next) {
-        int matched = !strncmp(tmp->url, url, strlen(url));
+cache_block_t *cache_block_find(const char *url, uint64_t hash) {
+    cache_block_t *tmp;
+    for (tmp = buckets[hash % CACHE_BUCKETS]; tmp != NULL; tmp = tmp->hnext) {
+        int matched = tmp->hash == hash && !strcmp(tmp->url, url);
         if (matched) {
             return tmp;
         }
     }
     return NULL;
 }
+/**
+ * @brief Check if the url content is in the cache, without sending it.
+ */
+bool cache_contains(const char *url, uint64_t hash) {
+    prof_mutex_lock(&cacheLock);
+    bool found = cache_block_find(url, hash) != NULL;
+    prof_mutex_unlock(&cacheLock);
+    return found;
+}
+/**
+ * @brief Get the number of bytes used by cached objects.
+ */
+size_t cache_bytes() {
+    prof_mutex_lock(&cacheLock);
+    size_t bytes = total_cache_size + negative_cache_size;
+    prof_mutex_unlock(&cacheLock);
+    return bytes;
+}
+/**
+ * @brief Set the max number of bytes used by cached objects.
+ */
+void cache_set_budget(size_t bytes) {
+    prof_mutex_lock(&cacheLock);
+    budget_bytes = bytes;
+    // a smaller budget is made room for by the evictor
+    if (total_cache_size > CACHE_HIGH_WATER(budget_bytes)) {
+        pthread_cond_signal(&evictCond);
+    }
+    prof_mutex_unlock(&cacheLock);
+}
+/**
+ * @brief Get the max number of bytes used by cached objects.
+ */
+size_t cache_budget() {
+    prof_mutex_lock(&cacheLock);
+    size_t bytes = budget_bytes;
+    prof_mutex_unlock(&cacheLock);
+    return bytes;
+}
@@ -6,7 +6,9 @@
  * Proxy cache employ a least recently used (LRU) eviction policy
  */
 #include "csapp.h"
+#include "hash128.h"
 #include "http_parser.h"
+#include "wheel.h"
 #include <assert.h>
 #include <ctype.h>
 #include <inttypes.h>
@@ -16,6 +18,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 /*
  * Max cache and object sizes
@@ -23,28 +26,102 @@
  */
 #define MAX_CACHE_SIZE (1024 * 1024)
 #define MAX_OBJECT_SIZE (100 * 1024)
+// Watermarks of the evictor thread for a budget, which keep enough free
+// space that inserts of typical objects do not have to evict themselves; a
+// few large objects can still fill the whole budget
+#define CACHE_HIGH_WATER(budget) ((budget) - (budget) / 128)
+#define CACHE_LOW_WATER(budget) ((budget) - (budget) / 64)
+// Number of hash buckets used to look up blocks by key
+#define CACHE_BUCKETS 1024
+// Separate budget for negatively cached (error) responses
+#define MAX_NEGATIVE_CACHE_SIZE (64 * 1024)
+// Default TTLs in seconds of negatively cached responses
+#define NEGATIVE_TTL_404 60
+#define NEGATIVE_TTL_410 300
+// Width of the Age value patched into the header block on cache hits
+#define AGE_WIDTH 10
+// Number of iovecs needed to send a cached response
+#define CACHE_IOV_CNT 4
+// Pre-rendered header block of a cached response
+typedef struct {
+    char *data;     // header lines, ending with the empty line
+    size_t len;     // length of the header block
+    size_t age_off; // offset of the fixed-width Age value
+} cache_header_t;
+// Body shared by all the blocks whose responses have identical bodies
+typedef struct cache_body_t {
+    uint64_t digest[2];         // 128-bit hash of the plain body
+    char *alloc;                // allocation holding data, freed with it
+    char *data;                 // body, gzip-compressed if gzipped
+    size_t len;                 // length of data
+    size_t plain_len;           // length of the body before compression
+    bool gzipped;               // data is gzip-compressed
+    bool shared;                // in the body table and counted once
+    int linked;                 // cached blocks pointing to this body
+    int refcnt;                 // blocks pointing to this body
+    struct cache_body_t *hnext; // next body in the same hash bucket
+} cache_body_t;
+// Hash of the body of a response, computed while it is relayed
+typedef struct {
+    size_t hdr_len;      // length of the header block, 0 until complete
+    size_t scanned;      // bytes of the response seen so far
+    hash128_t body_hash; // hash of the body bytes seen so far
+} cache_digest_t;
+// A response written into cache storage while it is relayed
+typedef struct cache_fill_t {
+    char *data;                // storage of MAX_OBJECT_SIZE bytes
+    size_t len;                // bytes of the response received so far
+    cache_digest_t digest;     // hash of the body received so far
+    const char *url;           // key reserved by cache_acquire(), or NULL
+    uint64_t hash;             // hash of the key
+    struct cache_fill_t *next; // next reserved fill in the same hash bucket
+} cache_fill_t;
+// Outcome of cache_acquire()
+typedef enum {
+    CACHE_HIT,    // cached, to be sent with cache_send()
+    CACHE_MISS,   // not cached, reserved for the caller to fill
+    CACHE_FILLING // not cached, and being filled by another request
+} cache_result_t;
 // Cache block structure for one url
 typedef struct cache_block_t {
-    char *url;                  // url: host + port + path
-    char *body;                 // body of the web object
-    size_t size;                // size of this block
-    int LRU_cnt;                // timer used to find LRU, longer, bigger
-    int thread_cnt;             // number of threads currently using this block
-    struct cache_block_t *next; // pointer to next block
-    struct cache_block_t *prev; // pointer to the prev block
+    char *url;                   // canonical key of the url, see cache_key.h
+    uint64_t hash;               // hash of the key
+    cache_header_t header;       // header block sent with the plain body
+    cache_header_t gzip_header;  // header block sent with the gzip body
+    cache_body_t *body;          // body, possibly shared with other blocks
+    size_t size;                 // size of this block, without shared body
+    int status;                  // HTTP status code of the response
+    bool negative;               // error response, uses the negative budget
+    time_t expires;              // expiry time, 0 if it does not expire
+    wheel_timer_t timer;         // expiry timer, pending if expires is set
+    time_t stored;               // time the response was cached, for Age
+    int LRU_cnt;                 // timer used to find LRU, longer, bigger
+    int thread_cnt;              // number of threads using this block
+    struct cache_block_t *next;  // pointer to next block
+    struct cache_block_t *prev;  // pointer to the prev block
+    struct cache_block_t *hnext; // next block in the same hash bucket
 } cache_block_t;
 /**
  * @brief Inintialize the cache linked list
  */
 void cache_init();
 /**
- * @brief Free the cache linked list.
+ * @brief Start the evictor thread, which keeps the cache between the
+ * CACHE_LOW_WATER and CACHE_HIGH_WATER of its budget in the background.
+ *
+ * @return 0, or -1 if the thread cannot be created
+ */
+int cache_evictor_start();
+/**
+ * @brief Free a block and drop its reference to its body.
+ * cacheLock must be held.
  * @param block
  */
 void cache_block_free(cache_block_t *block);
 /**
  * @brief Get the least recent use block.
- * The block that has the largest LRU_cnt value.
+ * The block that has the largest LRU_cnt value, among the blocks
+ * that are not negatively cached.
  */
 cache_block_t *LRU_get();
 /**
@@ -55,9 +132,10 @@ void increase_time();
  * @brief Find if the url content is in the cache.
  * If not, return NULL. If in the cache, return the block.
  *
- * @param url
+ * @param url canonical key
+ * @param hash hash of the key
  */
-cache_block_t *cache_block_find(char *url);
+cache_block_t *cache_block_find(const char *url, uint64_t hash);
 /**
  * @brief Inert a block into cache linked list
  *
@@ -66,8 +144,95 @@ cache_block_t *cache_block_find(char *url);
 void insert_head(cache_block_t *block);
 /**
  * @brief Insert a new data into cache.
+ * The response is split into a pre-rendered header block, which gets
+ * Age and X-Cache headers, and the body, so hits need no formatting.
+ * Compressible bodies are stored gzipped if enabled by cache_set_gzip().
+ * Bodies are stored once per content: blocks whose bodies have the same
+ * digest and, compared byte for byte, the same bytes share a single copy,
+ * and the budget counts it once.
+ * Responses expire after their Cache-Control s-maxage or max-age, or the
+ * TTL set by cache_set_default_ttl(), and are removed from the cache on
+ * time by the evictor thread; those with a max-age of 0 are not stored.
+ *
+ * @param digest body hash computed while relaying, or NULL
+ */
+void cache_insert(const char *url, uint64_t hash, char *body, size_t size,
+                  cache_digest_t *digest);
+/**
+ * @brief Look up a key and, on a miss, reserve it for the caller, all under
+ * a single acquisition of cacheLock.
+ * On a hit, the block is held for the caller until cache_send() or
+ * cache_release(). On a miss, fill gets storage as with cache_fill_reserve()
+ * and the key, so that concurrent requests for it get CACHE_FILLING until
+ * the fill is committed or aborted. CACHE_FILLING is also returned if
+ * there is no memory for the storage.
+ *
+ * @param url canonical key, which must live until the fill ends
+ * @param hash hash of the key, computed once by the caller
+ * @param[out] block the block on a hit
+ * @param[out] fill the fill on a miss
+ */
+cache_result_t cache_acquire(const char *url, uint64_t hash,
+                             cache_block_t **block, cache_fill_t *fill);
+/**
+ * @brief Send a block from cache_acquire() to a client and release it.
+ * Gzipped bodies are inflated on the fly unless the client accepts gzip.
+ *
+ * @return false if the response could not be sent
+ */
+bool cache_send(int fd, cache_block_t *block, bool accept_gzip);
+/**
+ * @brief Release a block from cache_acquire() without sending it.
+ */
+void cache_release(cache_block_t *block);
+/**
+ * @brief Reserve storage for a response about to be relayed, without
+ * reserving a key, e.g. for a response that will not be cached. It is
+ * borrowed from the buffer pool, whose buffers must be MAX_OBJECT_SIZE
+ * bytes. Bytes are written at data + len and accounted with
+ * cache_fill_append(); the fill then ends with either cache_fill_commit()
+ * or cache_fill_abort().
+ *
+ * @return false if out of memory
+ */
+bool cache_fill_reserve(cache_fill_t *fill);
+/**
+ * @brief Account for n bytes written at data + len. Once the response no
+ * longer fits, len keeps counting but the bytes are not hashed, and the
+ * storage may be reused as a scratch buffer until the fill ends.
+ */
+void cache_fill_append(cache_fill_t *fill, size_t n);
+/**
+ * @brief Insert a filled response under the key reserved by cache_acquire(),
+ * like cache_insert(), but with its storage adopted as the cached body
+ * instead of copied. Responses that do not fit or are not cacheable, and
+ * fills without a key, are aborted instead.
+ */
+void cache_fill_commit(cache_fill_t *fill);
+/**
+ * @brief Release the storage of a response that is not cached, and its
+ * key if reserved.
+ */
+void cache_fill_abort(cache_fill_t *fill);
+/**
+ * @brief Start hashing the body of a response.
+ */
+void cache_digest_init(cache_digest_t *digest);
+/**
+ * @brief Hash the bytes of a response received since the last update.
+ * The header block is skipped once its end is found.
+ *
+ * @param resp the response received so far
+ * @param len length of the response received so far
+ */
+void cache_digest_update(cache_digest_t *digest, const char *resp, size_t len);
+/**
+ * @brief Unlink a block from the cache, and free it once cacheLock is
+ * released unless a thread is still sending it.
+ *
+ * @param block
  */
-void cache_insert(char *url, char *body, size_t size);
+void cache_block_remove(cache_block_t *block);
 /**
  * @brief Remove the block that content has not been used for the
  * longest time amoung all blocks.
@@ -76,8 +241,87 @@ void cache_insert(char *url, char *body, size_t size);
  */
 void cache_block_evict(size_t size);
 /**
- * @brief Sent data directly to client if it is in the cache.
+ * @brief Make room in the negative budget, removing expired blocks first
+ * and then the least recently used negative blocks.
+ *
+ * @param size
+ */
+void cache_negative_evict(size_t size);
+/**
+ * @brief Set the TTL of negatively cached responses with a given status.
+ * A TTL of 0 disables negative caching for that status.
+ *
+ * @param status HTTP status code between 400 and 599
+ * @param ttl time to live in seconds
+ * @return 0 on success, -1 if the status is out of range
+ */
+int cache_set_negative_ttl(int status, int ttl);
+/**
+ * @brief Describe the response of a cached block as an iovec array.
+ * Only the fixed-width Age value is filled in, into the age buffer.
+ * A gzipped body can only be described for a client that accepts gzip.
+ *
+ * @param block
+ * @param iov array of CACHE_IOV_CNT iovecs
+ * @param age buffer of AGE_WIDTH bytes, must live until the iovecs are sent
+ * @param gzip describe the gzip response rather than the plain one
+ * @return the number of iovecs used
+ */
+int cache_block_iov(cache_block_t *block, struct iovec *iov, char *age,
+                    bool gzip);
+/**
+ * @brief Enable or disable gzip storage of compressible bodies.
+ * Must be called before the proxy starts handling requests.
+ */
+void cache_set_gzip(bool enable);
+/**
+ * @brief Set the TTL in seconds of responses without a Cache-Control
+ * max-age or s-maxage, 0 (the default) for none. Must be called before the
+ * proxy starts handling requests.
+ */
+void cache_set_default_ttl(int ttl);
+/**
+ * @brief Check if the url content is in the cache, without sending it.
+ *
+ * @param url canonical key
+ * @param hash hash of the key
+ */
+bool cache_contains(const char *url, uint64_t hash);
+/**
+ * @brief Get the number of bytes used by cached objects, in both the
+ * main and the negative budgets.
+ */
+size_t cache_bytes();
+/**
+ * @brief Set the max number of bytes used by cached objects outside of the
+ * negative budget, MAX_CACHE_SIZE unless changed. Objects over a smaller
+ * budget are evicted in the background.
+ */
+void cache_set_budget(size_t bytes);
+/**
+ * @brief Get the max number of bytes used by cached objects outside of the
+ * negative budget.
+ */
+size_t cache_budget();
+/**
+ * @brief Parse the status code from the status line of a response.
+ *
+ * @return the status code, or -1 if the response has no valid status line
+ */
+int response_status(const char *body, size_t size);
+/**
+ * @brief Find the end of the header block of a response.
+ *
+ * @param from offset to start searching from
+ * @return length of the header block including the empty line,
+ * or 0 if the response has no complete header block
+ */
+size_t header_length(const char *resp, size_t from, size_t size);
+/**
+ * @brief Find the value of a header in a header block.
  *
- * @return false if not found in cache
+ * @param[out] len length of the value, without surrounding whitespace
+ * @return the value, or NULL if the header is missing
  */
-bool cache_check(int fd, char *url);
+const char *header_value(const char *resp, size_t hdr_len, const char *name,
+                         size_t *len);
@@ -0,0 +1,279 @@
+/**
+ * @file cache_key.c
+ * @author Xianwei Zou
+ * @brief Canonical cache keys for request URIs.
+ */
+#include "cache_key.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+/* Query parameter configuration, set once at startup */
+static bool sort_query = false;
+static char *strip_params[CACHE_KEY_MAX_STRIP];
+static int strip_cnt = 0;
+/* Output cursor over the caller's key buffer */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool overflow;
+} key_out_t;
+/* A query parameter inside the key buffer */
+typedef struct {
+    const char *start;
+    size_t len;
+} key_param_t;
+/**
+ * @brief Enable or disable sorting of query parameters in keys.
+ */
+void cache_key_sort_query(bool sort) {
+    sort_query = sort;
+}
+/**
+ * @brief Strip a query parameter from all keys.
+ */
+int cache_key_strip_param(const char *name) {
+    if (strip_cnt == CACHE_KEY_MAX_STRIP) {
+        return -1;
+    }
+    char *copy = strdup(name);
+    if (copy == NULL) {
+        return -1;
+    }
+    strip_params[strip_cnt++] = copy;
+    return 0;
+}
+/**
+ * @brief Hash a canonical key (64-bit FNV-1a).
+ */
+uint64_t cache_key_hash(const char *key, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+static void out_putc(key_out_t *out, char c) {
+    if (out->len + 1 < out->cap) {
+        out->buf[out->len++] = c;
+    } else {
+        out->overflow = true;
+    }
+}
+static void out_puts(key_out_t *out, const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out_putc(out, s[i]);
+    }
+}
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    return tolower((unsigned char)c) - 'a' + 10;
+}
+/* Unreserved characters from RFC 3986, which never need escaping */
+static bool is_unreserved(int c) {
+    return isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+/**
+ * @brief Copy a path or query, normalizing its percent-encoding.
+ * Escaped unreserved characters are decoded, other escapes are uppercased.
+ */
+static void out_normalized(key_out_t *out, const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '%' && i + 2 < n && isxdigit((unsigned char)s[i + 1]) &&
+            isxdigit((unsigned char)s[i + 2])) {
+            int c = hex_value(s[i + 1]) * 16 + hex_value(s[i + 2]);
+            if (is_unreserved(c)) {
+                out_putc(out, (char)c);
+            } else {
+                out_putc(out, '%');
+                out_putc(out, (char)toupper((unsigned char)s[i + 1]));
+                out_putc(out, (char)toupper((unsigned char)s[i + 2]));
+            }
+            i += 2;
+        } else {
+            out_putc(out, s[i]);
+        }
+    }
+}
+/**
+ * @brief Remove "." and ".." segments from an absolute path, in place.
+ * This is remove_dot_segments from RFC 3986, section 5.2.4.
+ *
+ * @return the new length of the path
+ */
+static size_t remove_dot_segments(char *path, size_t len) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < len) {
+        // path[in] is the '/' that starts the next segment
+        size_t seg = in + 1;
+        size_t end = seg;
+        while (end < len && path[end] != '/') {
+            end++;
+        }
+        size_t n = end - seg;
+        if (n == 1 && path[seg] == '.') {
+            // "/." is dropped
+        } else if (n == 2 && path[seg] == '.' && path[seg + 1] == '.') {
+            // "/.." drops the last segment already written
+            while (out > 0 && path[--out] != '/') {
+            }
+        } else {
+            memmove(path + out, path + in, end - in);
+            out += end - in;
+            in = end;
+            continue;
+        }
+        if (end == len) {
+            path[out++] = '/'; // keep the directory form of the last segment
+        }
+        in = end;
+    }
+    return out;
+}
+static bool param_stripped(const key_param_t *param) {
+    size_t name_len = 0;
+    while (name_len < param->len && param->start[name_len] != '=') {
+        name_len++;
+    }
+    for (int i = 0; i < strip_cnt; i++) {
+        if (strlen(strip_params[i]) == name_len &&
+            !strncmp(strip_params[i], param->start, name_len)) {
+            return true;
+        }
+    }
+    return false;
+}
+static int param_compare(const void *a, const void *b) {
+    const key_param_t *pa = a;
+    const key_param_t *pb = b;
+    size_t n = pa->len < pb->len ? pa->len : pb->len;
+    int cmp = memcmp(pa->start, pb->start, n);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (pa->len > pb->len) - (pa->len < pb->len);
+}
+/**
+ * @brief Strip and sort the query parameters that start at out->buf[start].
+ * The query is already normalized; it is rewritten in place.
+ */
+static void rewrite_query(key_out_t *out, size_t start) {
+    size_t qlen = out->len - start;
+    char *query = malloc(qlen);
+    if (query == NULL) {
+        return; // keep the query as it is
+    }
+    memcpy(query, out->buf + start, qlen);
+    key_param_t params[CACHE_KEY_MAX_PARAMS];
+    int cnt = 0;
+    size_t pos = 0;
+    while (pos < qlen && cnt < CACHE_KEY_MAX_PARAMS) {
+        size_t end = pos;
+        while (end < qlen && query[end] != '&') {
+            end++;
+        }
+        key_param_t param = {query + pos, end - pos};
+        if (param.len > 0 && !param_stripped(&param)) {
+            params[cnt++] = param;
+        }
+        pos = end + 1;
+    }
+    if (pos < qlen) {
+        // too many parameters to rewrite safely
+        free(query);
+        return;
+    }
+    if (sort_query) {
+        qsort(params, cnt, sizeof(key_param_t), param_compare);
+    }
+    out->len = start - 1; // drop the '?' until a parameter is kept
+    for (int i = 0; i < cnt; i++) {
+        out_putc(out, i == 0 ? '?' : '&');
+        out_puts(out, params[i].start, params[i].len);
+    }
+    free(query);
+}
+/**
+ * @brief Build the canonical cache key of a request-line URI.
+ */
+ssize_t cache_key_build(const char *uri, char *key, size_t keylen) {
+    key_out_t out = {key, 0, keylen, false};
+    const char *p = uri;
+    const char *scheme_end = strstr(uri, "://");
+    if (scheme_end != NULL &&
+        strcspn(uri, "/?#") > (size_t)(scheme_end - uri)) {
+        // scheme is case-insensitive
+        size_t scheme_len = scheme_end - uri;
+        for (size_t i = 0; i < scheme_len; i++) {
+            out_putc(&out, (char)tolower((unsigned char)uri[i]));
+        }
+        out_puts(&out, "://", 3);
+        // authority: [userinfo@]host[:port]
+        const char *auth = scheme_end + 3;
+        size_t auth_len = strcspn(auth, "/?#");
+        const char *host = auth;
+        const char *at = memchr(auth, '@', auth_len);
+        if (at != NULL) {
+            out_puts(&out, auth, at + 1 - auth);
+            host = at + 1;
+        }
+        size_t host_len = auth + auth_len - host;
+        // the port colon comes after the closing bracket of an IPv6 literal
+        const char *bracket = memchr(host, ']', host_len);
+        const char *search = bracket != NULL ? bracket : host;
+        const char *colon = memchr(search, ':', host + host_len - search);
+        size_t name_len = colon != NULL ? (size_t)(colon - host) : host_len;
+        for (size_t i = 0; i < name_len; i++) {
+            out_putc(&out, (char)tolower((unsigned char)host[i]));
+        }
+        if (colon != NULL) {
+            const char *port = colon + 1;
+            size_t port_len = host + host_len - port;
+            bool is_default =
+                port_len == 0 ||
+                (port_len == 2 && !strncmp(port, "80", 2) &&
+                 !strncasecmp(uri, "http", scheme_len) && scheme_len == 4) ||
+                (port_len == 3 && !strncmp(port, "443", 3) &&
+                 !strncasecmp(uri, "https", scheme_len) && scheme_len == 5);
+            if (!is_default) {
+                out_puts(&out, colon, port_len + 1);
+            }
+        }
+        p = auth + auth_len;
+    }
+    // path, always absolute
+    size_t path_len = strcspn(p, "?#");
+    size_t path_start = out.len;
+    if (path_len == 0 || p[0] != '/') {
+        out_putc(&out, '/');
+    }
+    out_normalized(&out, p, path_len);
+    if (!out.overflow) {
+        out.len = path_start + remove_dot_segments(out.buf + path_start,
+                                                   out.len - path_start);
+    }
+    p += path_len;
+    // query, without the fragment
+    if (*p == '?') {
+        size_t query_len = strcspn(p + 1, "#");
+        out_putc(&out, '?');
+        size_t query_start = out.len;
+        out_normalized(&out, p + 1, query_len);
+        if (!out.overflow && (sort_query || strip_cnt > 0)) {
+            rewrite_query(&out, query_start);
+        }
+    }
+    if (out.overflow || keylen == 0) {
+        return -1;
+    }
+    key[out.len] = '\0';
+    return (ssize_t)out.len;
+}
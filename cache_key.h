@@ -0,0 +1,54 @@
+/**
+ * @file cache_key.h
+ * @author Xianwei Zou
+ * @brief Canonical cache keys for request URIs.
+ *
+ * Different spellings of the same URL (for example "http://Host:80/a",
+ * "http://host/a" and "http://host/./a") are mapped to one key, so that
+ * they share a single cache entry. The key is built once per request and
+ * hashed once; the cache then compares the hash before the full key.
+ */
+#ifndef CACHE_KEY_H
+#define CACHE_KEY_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+/* Max number of query parameters that can be configured to be stripped */
+#define CACHE_KEY_MAX_STRIP 32
+/* Max number of query parameters handled when sorting a query string */
+#define CACHE_KEY_MAX_PARAMS 64
+/**
+ * @brief Build the canonical cache key of a request-line URI.
+ *
+ * The scheme and host are lowercased, the default port is dropped, dot
+ * segments are removed from the path, percent-encoded unreserved characters
+ * are decoded and the remaining escapes use uppercase hex digits. The
+ * fragment is dropped. Query parameters are sorted or stripped according to
+ * the configuration set by cache_key_sort_query() and cache_key_strip_param().
+ *
+ * @param uri the URI from the request line
+ * @param key buffer receiving the NUL-terminated key
+ * @param keylen size of the key buffer
+ *
+ * @return length of the key, at most one more than that of the URI (the
+ * '/' of an empty path), or -1 if it does not fit in the buffer
+ */
+ssize_t cache_key_build(const char *uri, char *key, size_t keylen);
+/**
+ * @brief Hash a canonical key (64-bit FNV-1a).
+ */
+uint64_t cache_key_hash(const char *key, size_t len);
+/**
+ * @brief Enable or disable sorting of query parameters in keys.
+ * Must be called before the proxy starts handling requests.
+ */
+void cache_key_sort_query(bool sort);
+/**
+ * @brief Strip a query parameter (e.g. a cache buster) from all keys.
+ * Must be called before the proxy starts handling requests.
+ *
+ * @return 0 on success, -1 if too many parameters are configured
+ */
+int cache_key_strip_param(const char *name);
+#endif /* CACHE_KEY_H */
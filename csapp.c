@@ -18,6 +18,7 @@
 #include <string.h>     /* memset() */
 #include <sys/socket.h> /* struct sockaddr */
 #include <sys/types.h>  /* struct sockaddr */
+#include <sys/uio.h>    /* writev() */
 #include <unistd.h>     /* STDIN_FILENO */
 
 /************************************
@@ -472,17 +473,45 @@ ssize_t rio_writen(int fd, const void *usrbuf, size_t n) {
 }
 
 /*
- * rio_read - This is a wrapper for the Unix read() function that
- *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
- *    buffer, where n is the number of bytes requested by the user and
- *    rio_cnt is the number of unread bytes in the internal buffer. On
- *    entry, rio_read() refills the internal buffer via a call to
- *    read() if the internal buffer is empty.
+ * rio_writevn - Robustly write all the bytes described by an iovec array
+ *    (unbuffered). The iovec array is consumed as the bytes are written.
  */
-static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n) {
-    size_t cnt;
+ssize_t rio_writevn(int fd, struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    ssize_t nwritten;
+
+    while (iovcnt > 0) {
+        if ((nwritten = writev(fd, iov, iovcnt)) < 0) {
+            if (errno != EINTR) {
+                return -1; /* errno set by writev() */
+            }
+
+            /* Interrupted by sig handler return, call writev() again */
+            nwritten = 0;
+        }
+        total += (size_t)nwritten;
 
-    while (rp->rio_cnt <= 0) { /* Refill if buf is empty */
+        /* Skip the vectors that were written completely */
+        while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+            nwritten -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + nwritten;
+            iov->iov_len -= (size_t)nwritten;
+        }
+    }
+    return (ssize_t)total;
+}
+
+/*
+ * rio_fill - Refill the internal buffer of rp, which must be empty, with
+ *    a call to read(). Returns the number of bytes read, 0 on EOF or -1
+ *    on error.
+ */
+static ssize_t rio_fill(rio_t *rp) {
+    while (rp->rio_cnt <= 0) {
         rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, sizeof(rp->rio_buf));
         if (rp->rio_cnt < 0) {
             if (errno != EINTR) {
@@ -496,6 +525,24 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n) {
             rp->rio_bufptr = rp->rio_buf; /* Reset buffer ptr */
         }
     }
+    return rp->rio_cnt;
+}
+
+/*
+ * rio_read - This is a wrapper for the Unix read() function that
+ *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
+ *    buffer, where n is the number of bytes requested by the user and
+ *    rio_cnt is the number of unread bytes in the internal buffer. On
+ *    entry, rio_read() refills the internal buffer via a call to
+ *    read() if the internal buffer is empty.
+ */
+static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n) {
+    size_t cnt;
+    ssize_t rc;
+
+    if ((rc = rio_fill(rp)) <= 0) {
+        return rc; /* EOF or error */
+    }
 
     /* Copy min(n, rp->rio_cnt) bytes from internal buf to user buf */
     cnt = n;
@@ -518,7 +565,9 @@ void rio_readinitb(rio_t *rp, int fd) {
 }
 
 /*
- * rio_readnb - Robustly read n bytes (buffered)
+ * rio_readnb - Robustly read n bytes (buffered). Once the internal buffer
+ *    is drained, requests of at least RIO_BUFSIZE bytes are read straight
+ *    into the user buffer, so large transfers are not copied twice.
  */
 ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n) {
     size_t nleft = n;
@@ -526,7 +575,15 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n) {
     char *bufp = usrbuf;
 
     while (nleft > 0) {
-        if ((nread = rio_read(rp, bufp, nleft)) < 0) {
+        if (rp->rio_cnt <= 0 && nleft >= sizeof(rp->rio_buf)) {
+            nread = read(rp->rio_fd, bufp, nleft);
+            if (nread < 0 && errno == EINTR) {
+                continue; /* Interrupted by sig handler return */
+            }
+        } else {
+            nread = rio_read(rp, bufp, nleft);
+        }
+        if (nread < 0) {
             return -1; /* errno set by read() */
         } else if (nread == 0) {
             break; /* EOF */
@@ -538,32 +595,180 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n) {
 }
 
 /*
- * rio_readlineb - Robustly read a text line (buffered)
+ * rio_readsomeb - Read up to n bytes (buffered), returning as soon as
+ *    some are available: the internal buffer if it holds any, else one
+ *    read(), straight into the user buffer as in rio_readnb().
+ */
+ssize_t rio_readsomeb(rio_t *rp, void *usrbuf, size_t n) {
+    ssize_t nread;
+
+    if (rp->rio_cnt > 0 || n < sizeof(rp->rio_buf)) {
+        return rio_read(rp, usrbuf, n);
+    }
+    while ((nread = read(rp->rio_fd, usrbuf, n)) < 0) {
+        if (errno != EINTR) {
+            return -1; /* errno set by read() */
+        }
+    }
+    return nread;
+}
+
+/*
+ * rio_readlineb - Robustly read a text line (buffered). The newline is
+ *    searched with memchr() over the internal buffer, and each buffered
+ *    part of the line is copied at once.
  */
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen) {
-    size_t n;
+    size_t n = 0, cnt;
     ssize_t rc;
-    char c, *bufp = usrbuf;
+    char *bufp = usrbuf, *nl = NULL;
 
-    for (n = 1; n < maxlen; n++) {
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-            *bufp++ = c;
-            if (c == '\n') {
-                n++;
-                break;
-            }
+    while (nl == NULL && n + 1 < maxlen) {
+        if ((rc = rio_fill(rp)) < 0) {
+            return -1; /* Error */
         } else if (rc == 0) {
-            if (n == 1) {
-                return 0; /* EOF, no data read */
-            } else {
-                break; /* EOF, some data was read */
+            break; /* EOF */
+        }
+        cnt = (size_t)rp->rio_cnt;
+        if (cnt > maxlen - 1 - n) {
+            cnt = maxlen - 1 - n;
+        }
+        if ((nl = memchr(rp->rio_bufptr, '\n', cnt)) != NULL) {
+            cnt = (size_t)(nl - rp->rio_bufptr) + 1;
+        }
+        memcpy(bufp + n, rp->rio_bufptr, cnt);
+        rp->rio_bufptr += cnt;
+        rp->rio_cnt -= cnt;
+        n += cnt;
+    }
+    if (maxlen > 0) {
+        bufp[n] = 0;
+    }
+    return (ssize_t)n;
+}
+
+/*
+ * rio_find - Find the first occurrence of delim in the n bytes at p
+ */
+static char *rio_find(char *p, size_t n, const char *delim, size_t dlen) {
+    char *end = p + n, *c;
+
+    while ((size_t)(end - p) >= dlen &&
+           (c = memchr(p, delim[0], (size_t)(end - p) - dlen + 1)) != NULL) {
+        if (!memcmp(c, delim, dlen)) {
+            return c;
+        }
+        p = c + 1;
+    }
+    return NULL;
+}
+
+/*
+ * rio_peekb - Find the next bytes of the internal buffer up to and
+ *    including delim, without copying or consuming them. On success,
+ *    *peekp points to the bytes, which are not null terminated. They are
+ *    only valid until the next call on rp, but may be modified in place.
+ *    If delim does not come before the buffer is full or EOF, all buffered
+ *    bytes are returned. Returns 0 on EOF with no data, -1 on error.
+ */
+ssize_t rio_peekb(rio_t *rp, const char *delim, char **peekp) {
+    size_t dlen = strlen(delim), scanned = 0;
+    ssize_t rc;
+    char *end;
+
+    if ((rc = rio_fill(rp)) <= 0) {
+        return rc; /* EOF or error */
+    }
+    while ((end = rio_find(rp->rio_bufptr + scanned,
+                           (size_t)rp->rio_cnt - scanned, delim, dlen)) ==
+           NULL) {
+        if ((size_t)rp->rio_cnt == sizeof(rp->rio_buf)) {
+            break; /* delim not within the buffer */
+        }
+
+        /* delim may straddle the bytes read next */
+        scanned = (size_t)rp->rio_cnt >= dlen ? (size_t)rp->rio_cnt - dlen + 1
+                                              : 0;
+
+        /* Move the partial data to the front and read more after it */
+        if (rp->rio_bufptr != rp->rio_buf) {
+            memmove(rp->rio_buf, rp->rio_bufptr, (size_t)rp->rio_cnt);
+            rp->rio_bufptr = rp->rio_buf;
+        }
+        rc = read(rp->rio_fd, rp->rio_buf + rp->rio_cnt,
+                  sizeof(rp->rio_buf) - (size_t)rp->rio_cnt);
+        if (rc < 0) {
+            if (errno != EINTR) {
+                return -1; /* errno set by read() */
             }
+        } else if (rc == 0) {
+            break; /* EOF, delim not found */
         } else {
-            return -1; /* Error */
+            rp->rio_cnt += rc;
         }
     }
-    *bufp = 0;
-    return (ssize_t)(n - 1);
+    *peekp = rp->rio_bufptr;
+    return end ? end + dlen - rp->rio_bufptr : rp->rio_cnt;
+}
+
+/*
+ * rio_peeklineb - Find the next text line in the internal buffer without
+ *    copying or consuming it, as rio_peekb() does with a newline. The
+ *    returned length includes the newline. A line longer than the buffer,
+ *    or ended by EOF, is returned in part, without a newline.
+ */
+ssize_t rio_peeklineb(rio_t *rp, char **linep) {
+    return rio_peekb(rp, "\n", linep);
+}
+
+/*
+ * rio_consumeb - Skip n bytes of the internal buffer, e.g. a line
+ *    returned by rio_peeklineb(). n must not exceed the buffered bytes.
+ */
+void rio_consumeb(rio_t *rp, size_t n) {
+    rp->rio_bufptr += n;
+    rp->rio_cnt -= (ssize_t)n;
+}
+
+/*
+ * rio_outinitb - Associate a descriptor with an output buffer
+ */
+void rio_outinitb(rio_out_t *op, int fd) {
+    op->rio_fd = fd;
+    op->rio_cnt = 0;
+}
+
+/*
+ * rio_writeb - Robustly write n bytes (buffered). Writes that fit are
+ *    copied into the output buffer; a larger one is sent along with the
+ *    buffered bytes in a single writev(), without copying it.
+ */
+ssize_t rio_writeb(rio_out_t *op, const void *usrbuf, size_t n) {
+    if (op->rio_cnt + n <= sizeof(op->rio_buf)) {
+        memcpy(op->rio_buf + op->rio_cnt, usrbuf, n);
+        op->rio_cnt += n;
+        return (ssize_t)n;
+    }
+    struct iovec iov[2] = {{op->rio_buf, op->rio_cnt},
+                           {(void *)usrbuf, n}};
+    if (rio_writevn(op->rio_fd, iov, 2) < 0) {
+        return -1; /* errno set by writev() */
+    }
+    op->rio_cnt = 0;
+    return (ssize_t)n;
+}
+
+/*
+ * rio_flushb - Send the bytes left in the output buffer
+ */
+ssize_t rio_flushb(rio_out_t *op) {
+    ssize_t rc = 0;
+
+    if (op->rio_cnt > 0) {
+        rc = rio_writen(op->rio_fd, op->rio_buf, op->rio_cnt);
+        op->rio_cnt = 0;
+    }
+    return rc;
 }
 
 /********************************
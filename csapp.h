@@ -41,6 +41,7 @@
 #include <stdarg.h>    /* va_list */
 #include <stddef.h>    /* size_t */
 #include <sys/types.h> /* ssize_t */
+#include <sys/uio.h>   /* struct iovec */
 
 /* Default file permissions are DEF_MODE & ~DEF_UMASK */
 #define DEF_MODE S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH
@@ -55,6 +56,13 @@ typedef struct {
     char rio_buf[RIO_BUFSIZE]; /* Internal buffer */
 } rio_t;
 
+/* Persistent state for buffered output */
+typedef struct {
+    int rio_fd;                /* Descriptor for this output buf */
+    size_t rio_cnt;            /* Unsent bytes in output buf */
+    char rio_buf[RIO_BUFSIZE]; /* Output buffer */
+} rio_out_t;
+
 /* External variables */
 extern int h_errno;    /* Defined by BIND for DNS errors */
 extern char **environ; /* Defined by libc */
@@ -93,9 +101,17 @@ void Free(void *ptr);
 /* Rio (Robust I/O) package */
 ssize_t rio_readn(int fd, void *usrbuf, size_t n);
 ssize_t rio_writen(int fd, const void *usrbuf, size_t n);
+ssize_t rio_writevn(int fd, struct iovec *iov, int iovcnt);
 void rio_readinitb(rio_t *rp, int fd);
 ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n);
+ssize_t rio_readsomeb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t rio_peekb(rio_t *rp, const char *delim, char **peekp);
+ssize_t rio_peeklineb(rio_t *rp, char **linep);
+void rio_consumeb(rio_t *rp, size_t n);
+void rio_outinitb(rio_out_t *op, int fd);
+ssize_t rio_writeb(rio_out_t *op, const void *usrbuf, size_t n);
+ssize_t rio_flushb(rio_out_t *op);
 
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(const char *hostname, const char *port);
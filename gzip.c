@@ -0,0 +1,162 @@
+/**
+ * @file gzip.c
+ * @author Xianwei Zou
+ * @brief Gzip compression of cached bodies, on top of zlib.
+ */
+#include "gzip.h"
+#include "csapp.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+// MIME types that compress well
+static const char *compressible_types[] = {
+    "text/",           "application/json", "application/javascript",
+    "application/xml", "image/svg+xml",    NULL};
+/**
+ * @brief Check if a MIME type is worth compressing.
+ */
+bool gzip_compressible(const char *type, size_t len) {
+    for (int i = 0; compressible_types[i] != NULL; i++) {
+        size_t n = strlen(compressible_types[i]);
+        if (len >= n && !strncasecmp(type, compressible_types[i], n)) {
+            return true;
+        }
+    }
+    // structured syntax suffixes, e.g. application/ld+json
+    size_t sub = strcspn(type, ";");
+    if (sub > len) {
+        sub = len;
+    }
+    return (sub >= 5 && !strncasecmp(type + sub - 5, "+json", 5)) ||
+           (sub >= 4 && !strncasecmp(type + sub - 4, "+xml", 4));
+}
+/**
+ * @brief Check if an Accept-Encoding header value accepts gzip.
+ */
+bool gzip_accepted(const char *value) {
+    const char *p = value;
+    while (*p != '\0') {
+        while (isspace((unsigned char)*p) || *p == ',') {
+            p++;
+        }
+        size_t n = strcspn(p, " \t\r\n;,");
+        bool gzip = (n == 4 && !strncasecmp(p, "gzip", 4)) ||
+                    (n == 6 && !strncasecmp(p, "x-gzip", 6)) ||
+                    (n == 1 && *p == '*');
+        p += n;
+        // an explicit q=0 refuses the coding
+        bool refused = false;
+        const char *params = p;
+        p += strcspn(p, ",");
+        const char *q = params;
+        while ((q = strchr(q, ';')) != NULL && q < p) {
+            q++;
+            while (*q == ' ' || *q == '\t') {
+                q++;
+            }
+            if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=') {
+                refused = strtod(q + 2, NULL) == 0.0;
+            }
+        }
+        if (gzip && !refused) {
+            return true;
+        }
+    }
+    return false;
+}
+/**
+ * @brief Compress data into a new gzip buffer.
+ */
+char *gzip_deflate(const char *data, size_t len, size_t *out_len) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits + 16 selects the gzip wrapper
+    if (deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t cap = deflateBound(&zs, len);
+    char *out = malloc(cap);
+    if (out == NULL) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = (uInt)cap;
+    int rc = deflate(&zs, Z_FINISH);
+    *out_len = zs.total_out;
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END || *out_len > len - len / 8) {
+        free(out);
+        return NULL;
+    }
+    char *shrunk = realloc(out, *out_len);
+    return shrunk != NULL ? shrunk : out;
+}
+/**
+ * @brief Inflate gzip data and write it to an output buffer.
+ */
+ssize_t gzip_inflate_writeb(rio_out_t *op, const char *data, size_t len) {
+    char chunk[GZIP_CHUNK];
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        return -1;
+    }
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)len;
+    size_t total = 0;
+    int rc = Z_OK;
+    while (rc != Z_STREAM_END) {
+        zs.next_out = (Bytef *)chunk;
+        zs.avail_out = sizeof(chunk);
+        rc = inflate(&zs, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END) {
+            inflateEnd(&zs);
+            return -1;
+        }
+        size_t n = sizeof(chunk) - zs.avail_out;
+        if (n > 0 && rio_writeb(op, chunk, n) < 0) {
+            inflateEnd(&zs);
+            return -1;
+        }
+        total += n;
+    }
+    inflateEnd(&zs);
+    return (ssize_t)total;
+}
+/**
+ * @brief Check if gzip data inflates to exactly the given plain data.
+ */
+bool gzip_inflate_equal(const char *gz, size_t gz_len, const char *data,
+                        size_t len) {
+    char chunk[GZIP_CHUNK];
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        return false;
+    }
+    zs.next_in = (Bytef *)gz;
+    zs.avail_in = (uInt)gz_len;
+    size_t total = 0;
+    int rc = Z_OK;
+    while (rc != Z_STREAM_END) {
+        zs.next_out = (Bytef *)chunk;
+        zs.avail_out = sizeof(chunk);
+        rc = inflate(&zs, Z_NO_FLUSH);
+        size_t n = sizeof(chunk) - zs.avail_out;
+        if ((rc != Z_OK && rc != Z_STREAM_END) || n > len - total ||
+            memcmp(chunk, data + total, n)) {
+            inflateEnd(&zs);
+            return false;
+        }
+        total += n;
+    }
+    inflateEnd(&zs);
+    return total == len;
+}
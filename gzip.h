@@ -0,0 +1,61 @@
+/**
+ * @file gzip.h
+ * @author Xianwei Zou
+ * @brief Gzip compression of cached bodies, on top of zlib.
+ *
+ * Compressible bodies (text, JSON, JavaScript, XML) can be stored gzipped in
+ * the cache. Clients that accept gzip get the stored bytes directly, other
+ * clients get the body inflated on the fly while it is sent.
+ */
+#ifndef GZIP_H
+#define GZIP_H
+#include "csapp.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+// Compression level used for cached bodies
+#define GZIP_LEVEL 6
+// Bodies smaller than this are not worth compressing
+#define GZIP_MIN_SIZE 256
+// Size of the stack buffer used when inflating to a client
+#define GZIP_CHUNK 8192
+/**
+ * @brief Check if a MIME type is worth compressing.
+ *
+ * @param type value of the Content-Type header
+ * @param len length of the value
+ */
+bool gzip_compressible(const char *type, size_t len);
+/**
+ * @brief Check if an Accept-Encoding header value accepts gzip.
+ *
+ * @param value value of the header, NUL-terminated
+ */
+bool gzip_accepted(const char *value);
+/**
+ * @brief Compress data into a new gzip buffer.
+ *
+ * @param data
+ * @param len
+ * @param[out] out_len length of the compressed data
+ * @return a malloc'ed buffer, or NULL if compression fails or does not
+ * save at least an eighth of the size
+ */
+char *gzip_deflate(const char *data, size_t len, size_t *out_len);
+/**
+ * @brief Inflate gzip data and write it to an output buffer, which the
+ * caller flushes.
+ *
+ * @return number of bytes written, or -1 on error
+ */
+ssize_t gzip_inflate_writeb(rio_out_t *op, const char *data, size_t len);
+/**
+ * @brief Check if gzip data inflates to exactly the given plain data.
+ *
+ * @param gz gzip data
+ * @param gz_len length of the gzip data
+ * @return false if it differs or cannot be inflated
+ */
+bool gzip_inflate_equal(const char *gz, size_t gz_len, const char *data,
+                        size_t len);
+#endif /* GZIP_H */
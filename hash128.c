@@ -0,0 +1,113 @@
+/**
+ * @file hash128.c
+ * @author Xianwei Zou
+ * @brief Incremental 128-bit hash (MurmurHash3 x64_128, seed 0).
+ */
+#include "hash128.h"
+#include <stdint.h>
+#include <string.h>
+#define C1 0x87c37b91114253d5ULL
+#define C2 0x4cf5ad432745937fULL
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+static uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+static uint64_t mix_k1(uint64_t k1) {
+    k1 *= C1;
+    k1 = rotl64(k1, 31);
+    return k1 * C2;
+}
+static uint64_t mix_k2(uint64_t k2) {
+    k2 *= C2;
+    k2 = rotl64(k2, 33);
+    return k2 * C1;
+}
+/**
+ * @brief Mix one 16-byte block into the state (little-endian load).
+ */
+static void hash_block(hash128_t *st, const unsigned char *p) {
+    uint64_t k1, k2;
+    memcpy(&k1, p, 8);
+    memcpy(&k2, p + 8, 8);
+    st->h1 ^= mix_k1(k1);
+    st->h1 = rotl64(st->h1, 27);
+    st->h1 += st->h2;
+    st->h1 = st->h1 * 5 + 0x52dce729;
+    st->h2 ^= mix_k2(k2);
+    st->h2 = rotl64(st->h2, 31);
+    st->h2 += st->h1;
+    st->h2 = st->h2 * 5 + 0x38495ab5;
+}
+/**
+ * @brief Start a new hash.
+ */
+void hash128_init(hash128_t *st) {
+    st->h1 = 0;
+    st->h2 = 0;
+    st->tail_len = 0;
+    st->total = 0;
+}
+/**
+ * @brief Add data to a hash.
+ */
+void hash128_update(hash128_t *st, const void *data, size_t len) {
+    const unsigned char *p = data;
+    st->total += len;
+    // complete the pending block first
+    if (st->tail_len > 0) {
+        size_t n = 16 - st->tail_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(st->tail + st->tail_len, p, n);
+        st->tail_len += n;
+        p += n;
+        len -= n;
+        if (st->tail_len < 16) {
+            return;
+        }
+        hash_block(st, st->tail);
+        st->tail_len = 0;
+    }
+    for (; len >= 16; p += 16, len -= 16) {
+        hash_block(st, p);
+    }
+    memcpy(st->tail, p, len);
+    st->tail_len = len;
+}
+/**
+ * @brief Finish a hash.
+ */
+void hash128_final(hash128_t *st, uint64_t out[2]) {
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    for (size_t i = st->tail_len; i > 8; i--) {
+        k2 ^= (uint64_t)st->tail[i - 1] << ((i - 9) * 8);
+    }
+    for (size_t i = st->tail_len < 8 ? st->tail_len : 8; i > 0; i--) {
+        k1 ^= (uint64_t)st->tail[i - 1] << ((i - 1) * 8);
+    }
+    if (st->tail_len > 8) {
+        st->h2 ^= mix_k2(k2);
+    }
+    if (st->tail_len > 0) {
+        st->h1 ^= mix_k1(k1);
+    }
+    uint64_t h1 = st->h1 ^ st->total;
+    uint64_t h2 = st->h2 ^ st->total;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    out[0] = h1;
+    out[1] = h2;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file hash128.h
+ * @author Xianwei Zou
+ * @brief Incremental 128-bit hash (MurmurHash3 x64_128, seed 0).
+ *
+ * Used to identify cached bodies by content. The hash can be fed in chunks
+ * of any size as data is relayed, and gives the same result as hashing the
+ * whole buffer at once.
+ */
+#ifndef HASH128_H
+#define HASH128_H
+#include <stddef.h>
+#include <stdint.h>
+// State of an incremental hash
+typedef struct {
+    uint64_t h1;            // first half of the state
+    uint64_t h2;            // second half of the state
+    unsigned char tail[16]; // bytes not yet forming a full 16-byte block
+    size_t tail_len;        // number of bytes in tail
+    size_t total;           // total number of bytes hashed
+} hash128_t;
+/**
+ * @brief Start a new hash.
+ */
+void hash128_init(hash128_t *st);
+/**
+ * @brief Add data to a hash.
+ */
+void hash128_update(hash128_t *st, const void *data, size_t len);
+/**
+ * @brief Finish a hash. The state must not be updated afterwards.
+ *
+ * @param[out] out the 128-bit hash
+ */
+void hash128_final(hash128_t *st, uint64_t out[2]);
+#endif /* HASH128_H */
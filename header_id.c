@@ -0,0 +1,200 @@
+/* Generated by tools/gen_header_id.py, do not edit. */
+/**
+ * @file header_id.c
+ * @author Xianwei Zou
+ * @brief Identifiers of standard header names, from a perfect hash.
+ */
+#include "header_id.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <strings.h>
+const char *const header_id_names[HDR_CNT] = {
+    [HDR_ACCEPT] = "Accept",
+    [HDR_ACCEPT_CHARSET] = "Accept-Charset",
+    [HDR_ACCEPT_ENCODING] = "Accept-Encoding",
+    [HDR_ACCEPT_LANGUAGE] = "Accept-Language",
+    [HDR_ACCEPT_RANGES] = "Accept-Ranges",
+    [HDR_AGE] = "Age",
+    [HDR_ALLOW] = "Allow",
+    [HDR_AUTHORIZATION] = "Authorization",
+    [HDR_CACHE_CONTROL] = "Cache-Control",
+    [HDR_CONNECTION] = "Connection",
+    [HDR_CONTENT_DISPOSITION] = "Content-Disposition",
+    [HDR_CONTENT_ENCODING] = "Content-Encoding",
+    [HDR_CONTENT_LANGUAGE] = "Content-Language",
+    [HDR_CONTENT_LENGTH] = "Content-Length",
+    [HDR_CONTENT_LOCATION] = "Content-Location",
+    [HDR_CONTENT_RANGE] = "Content-Range",
+    [HDR_CONTENT_TYPE] = "Content-Type",
+    [HDR_COOKIE] = "Cookie",
+    [HDR_DATE] = "Date",
+    [HDR_DNT] = "DNT",
+    [HDR_ETAG] = "ETag",
+    [HDR_EXPECT] = "Expect",
+    [HDR_EXPIRES] = "Expires",
+    [HDR_FORWARDED] = "Forwarded",
+    [HDR_FROM] = "From",
+    [HDR_HOST] = "Host",
+    [HDR_IF_MATCH] = "If-Match",
+    [HDR_IF_MODIFIED_SINCE] = "If-Modified-Since",
+    [HDR_IF_NONE_MATCH] = "If-None-Match",
+    [HDR_IF_RANGE] = "If-Range",
+    [HDR_IF_UNMODIFIED_SINCE] = "If-Unmodified-Since",
+    [HDR_KEEP_ALIVE] = "Keep-Alive",
+    [HDR_LAST_MODIFIED] = "Last-Modified",
+    [HDR_LINK] = "Link",
+    [HDR_LOCATION] = "Location",
+    [HDR_MAX_FORWARDS] = "Max-Forwards",
+    [HDR_ORIGIN] = "Origin",
+    [HDR_PRAGMA] = "Pragma",
+    [HDR_PROXY_AUTHENTICATE] = "Proxy-Authenticate",
+    [HDR_PROXY_AUTHORIZATION] = "Proxy-Authorization",
+    [HDR_PROXY_CONNECTION] = "Proxy-Connection",
+    [HDR_RANGE] = "Range",
+    [HDR_REFERER] = "Referer",
+    [HDR_RETRY_AFTER] = "Retry-After",
+    [HDR_SERVER] = "Server",
+    [HDR_SET_COOKIE] = "Set-Cookie",
+    [HDR_TE] = "TE",
+    [HDR_TRAILER] = "Trailer",
+    [HDR_TRANSFER_ENCODING] = "Transfer-Encoding",
+    [HDR_UPGRADE] = "Upgrade",
+    [HDR_UPGRADE_INSECURE_REQUESTS] = "Upgrade-Insecure-Requests",
+    [HDR_USER_AGENT] = "User-Agent",
+    [HDR_VARY] = "Vary",
+    [HDR_VIA] = "Via",
+    [HDR_WARNING] = "Warning",
+    [HDR_WWW_AUTHENTICATE] = "WWW-Authenticate",
+    [HDR_X_FORWARDED_FOR] = "X-Forwarded-For",
+    [HDR_X_FORWARDED_HOST] = "X-Forwarded-Host",
+    [HDR_X_FORWARDED_PROTO] = "X-Forwarded-Proto",
+    [HDR_X_REQUESTED_WITH] = "X-Requested-With",
+};
+const unsigned char header_id_flags[HDR_CNT] = {
+    [HDR_CONNECTION] = HDR_HOP_BY_HOP | HDR_REWRITTEN,
+    [HDR_HOST] = HDR_REWRITTEN,
+    [HDR_KEEP_ALIVE] = HDR_HOP_BY_HOP,
+    [HDR_PROXY_AUTHENTICATE] = HDR_HOP_BY_HOP,
+    [HDR_PROXY_AUTHORIZATION] = HDR_HOP_BY_HOP,
+    [HDR_PROXY_CONNECTION] = HDR_HOP_BY_HOP | HDR_REWRITTEN,
+    [HDR_TE] = HDR_HOP_BY_HOP,
+    [HDR_TRAILER] = HDR_HOP_BY_HOP,
+    [HDR_TRANSFER_ENCODING] = HDR_HOP_BY_HOP,
+    [HDR_UPGRADE] = HDR_HOP_BY_HOP,
+    [HDR_USER_AGENT] = HDR_REWRITTEN,
+};
+static const unsigned char name_lens[HDR_CNT] = {
+    [HDR_ACCEPT] = 6,
+    [HDR_ACCEPT_CHARSET] = 14,
+    [HDR_ACCEPT_ENCODING] = 15,
+    [HDR_ACCEPT_LANGUAGE] = 15,
+    [HDR_ACCEPT_RANGES] = 13,
+    [HDR_AGE] = 3,
+    [HDR_ALLOW] = 5,
+    [HDR_AUTHORIZATION] = 13,
+    [HDR_CACHE_CONTROL] = 13,
+    [HDR_CONNECTION] = 10,
+    [HDR_CONTENT_DISPOSITION] = 19,
+    [HDR_CONTENT_ENCODING] = 16,
+    [HDR_CONTENT_LANGUAGE] = 16,
+    [HDR_CONTENT_LENGTH] = 14,
+    [HDR_CONTENT_LOCATION] = 16,
+    [HDR_CONTENT_RANGE] = 13,
+    [HDR_CONTENT_TYPE] = 12,
+    [HDR_COOKIE] = 6,
+    [HDR_DATE] = 4,
+    [HDR_DNT] = 3,
+    [HDR_ETAG] = 4,
+    [HDR_EXPECT] = 6,
+    [HDR_EXPIRES] = 7,
+    [HDR_FORWARDED] = 9,
+    [HDR_FROM] = 4,
+    [HDR_HOST] = 4,
+    [HDR_IF_MATCH] = 8,
+    [HDR_IF_MODIFIED_SINCE] = 17,
+    [HDR_IF_NONE_MATCH] = 13,
+    [HDR_IF_RANGE] = 8,
+    [HDR_IF_UNMODIFIED_SINCE] = 19,
+    [HDR_KEEP_ALIVE] = 10,
+    [HDR_LAST_MODIFIED] = 13,
+    [HDR_LINK] = 4,
+    [HDR_LOCATION] = 8,
+    [HDR_MAX_FORWARDS] = 12,
+    [HDR_ORIGIN] = 6,
+    [HDR_PRAGMA] = 6,
+    [HDR_PROXY_AUTHENTICATE] = 18,
+    [HDR_PROXY_AUTHORIZATION] = 19,
+    [HDR_PROXY_CONNECTION] = 16,
+    [HDR_RANGE] = 5,
+    [HDR_REFERER] = 7,
+    [HDR_RETRY_AFTER] = 11,
+    [HDR_SERVER] = 6,
+    [HDR_SET_COOKIE] = 10,
+    [HDR_TE] = 2,
+    [HDR_TRAILER] = 7,
+    [HDR_TRANSFER_ENCODING] = 17,
+    [HDR_UPGRADE] = 7,
+    [HDR_UPGRADE_INSECURE_REQUESTS] = 25,
+    [HDR_USER_AGENT] = 10,
+    [HDR_VARY] = 4,
+    [HDR_VIA] = 3,
+    [HDR_WARNING] = 7,
+    [HDR_WWW_AUTHENTICATE] = 16,
+    [HDR_X_FORWARDED_FOR] = 15,
+    [HDR_X_FORWARDED_HOST] = 16,
+    [HDR_X_FORWARDED_PROTO] = 17,
+    [HDR_X_REQUESTED_WITH] = 16,
+};
+/* Identifier of each slot of the hash, 0 if empty */
+static const unsigned char slots[512] = {
+    0, 38, 0, 0, 0, 0, 0, 0, 41, 0, 0, 0, 42, 0, 0, 0,
+    0, 0, 0, 37, 0, 0, 0, 0, 0, 0, 0, 26, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 39, 0, 0, 12, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 8, 44, 0, 0, 0, 48, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 15, 47, 20, 0, 0, 0, 0, 0, 59, 0,
+    17, 0, 0, 0, 0, 0, 0, 57, 0, 0, 11, 0, 0, 27, 0, 0,
+    0, 0, 0, 0, 0, 0, 34, 0, 0, 36, 45, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 58, 25, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 32, 0, 0, 0, 0, 0, 0, 28, 0, 0,
+    0, 0, 0, 0, 22, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 18, 60, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 19, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 24, 0, 50, 0,
+    0, 0, 0, 14, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 53, 0,
+    0, 35, 0, 0, 0, 0, 0, 0, 0, 9, 16, 0, 0, 0, 21, 0,
+    0, 52, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    33, 0, 0, 0, 0, 29, 0, 0, 0, 0, 0, 0, 55, 0, 0, 0,
+    0, 13, 0, 0, 46, 0, 30, 0, 0, 0, 23, 5, 0, 0, 0, 0,
+    0, 0, 0, 0, 51, 0, 0, 1, 0, 0, 0, 0, 49, 0, 0, 0,
+    43, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 56, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 3, 0, 0, 40, 54, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 6, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 31, 0, 0, 0, 0, 0, 0, 0,
+};
+/**
+ * @brief Identify a header name, compared case-insensitively.
+ */
+header_id_t header_id(const char *name, size_t len) {
+    if (len == 0 || len > 255) {
+        return HDR_UNKNOWN;
+    }
+    uint32_t h = (uint32_t)len * 52933u +
+                 (uint32_t)(name[0] | 0x20) * 55051u +
+                 (uint32_t)(name[len / 2] | 0x20) * 39369u +
+                 (uint32_t)(name[len - 1] | 0x20) * 593u;
+    header_id_t id = slots[(h * 0x9E3779B1u) >> (32 - 9)];
+    if (id == HDR_UNKNOWN || name_lens[id] != len ||
+        strncasecmp(name, header_id_names[id], len)) {
+        return HDR_UNKNOWN;
+    }
+    return id;
+}
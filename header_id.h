@@ -0,0 +1,95 @@
+/* Generated by tools/gen_header_id.py, do not edit. */
+/**
+ * @file header_id.h
+ * @author Xianwei Zou
+ * @brief Identifiers of standard header names, from a perfect hash.
+ *
+ * header_id() maps a header name to an enum with one hash and one
+ * case-insensitive compare, so that the proxy can dispatch on headers with
+ * a switch instead of comparing strings.
+ */
+#ifndef HEADER_ID_H
+#define HEADER_ID_H
+#include <stddef.h>
+/* Header is meaningful for a single connection and is not forwarded */
+#define HDR_HOP_BY_HOP 0x1
+/* Header is replaced by the proxy's own value */
+#define HDR_REWRITTEN 0x2
+/* Standard header names */
+typedef enum {
+    HDR_UNKNOWN,
+    HDR_ACCEPT,
+    HDR_ACCEPT_CHARSET,
+    HDR_ACCEPT_ENCODING,
+    HDR_ACCEPT_LANGUAGE,
+    HDR_ACCEPT_RANGES,
+    HDR_AGE,
+    HDR_ALLOW,
+    HDR_AUTHORIZATION,
+    HDR_CACHE_CONTROL,
+    HDR_CONNECTION,
+    HDR_CONTENT_DISPOSITION,
+    HDR_CONTENT_ENCODING,
+    HDR_CONTENT_LANGUAGE,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_LOCATION,
+    HDR_CONTENT_RANGE,
+    HDR_CONTENT_TYPE,
+    HDR_COOKIE,
+    HDR_DATE,
+    HDR_DNT,
+    HDR_ETAG,
+    HDR_EXPECT,
+    HDR_EXPIRES,
+    HDR_FORWARDED,
+    HDR_FROM,
+    HDR_HOST,
+    HDR_IF_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_RANGE,
+    HDR_IF_UNMODIFIED_SINCE,
+    HDR_KEEP_ALIVE,
+    HDR_LAST_MODIFIED,
+    HDR_LINK,
+    HDR_LOCATION,
+    HDR_MAX_FORWARDS,
+    HDR_ORIGIN,
+    HDR_PRAGMA,
+    HDR_PROXY_AUTHENTICATE,
+    HDR_PROXY_AUTHORIZATION,
+    HDR_PROXY_CONNECTION,
+    HDR_RANGE,
+    HDR_REFERER,
+    HDR_RETRY_AFTER,
+    HDR_SERVER,
+    HDR_SET_COOKIE,
+    HDR_TE,
+    HDR_TRAILER,
+    HDR_TRANSFER_ENCODING,
+    HDR_UPGRADE,
+    HDR_UPGRADE_INSECURE_REQUESTS,
+    HDR_USER_AGENT,
+    HDR_VARY,
+    HDR_VIA,
+    HDR_WARNING,
+    HDR_WWW_AUTHENTICATE,
+    HDR_X_FORWARDED_FOR,
+    HDR_X_FORWARDED_HOST,
+    HDR_X_FORWARDED_PROTO,
+    HDR_X_REQUESTED_WITH,
+    HDR_CNT
+} header_id_t;
+/* Canonical spelling of each name, NULL for HDR_UNKNOWN */
+extern const char *const header_id_names[HDR_CNT];
+/* HDR_* flags of each name */
+extern const unsigned char header_id_flags[HDR_CNT];
+/**
+ * @brief Identify a header name, compared case-insensitively.
+ *
+ * @param name the name, which needs no null terminator
+ * @param len length of the name
+ * @return the identifier, or HDR_UNKNOWN for other names
+ */
+header_id_t header_id(const char *name, size_t len);
+#endif /* HEADER_ID_H */
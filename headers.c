@@ -0,0 +1,129 @@
+/**
+ * @file headers.c
+ * @author Xianwei Zou
+ * @brief Zero-copy tokenizer of request headers.
+ */
+#include "headers.h"
+#include "arena.h"
+#include "csapp.h"
+#include "header_id.h"
+#include "scan.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+/* End of a header block, the last newline and the empty line */
+static const char *END_OF_HEADERS = "\n\r\n";
+/**
+ * @brief Check if a character is optional whitespace around a value.
+ */
+static bool is_ows(char c) {
+    return c == ' ' || c == '\t';
+}
+/**
+ * @brief Split a header line in place and add it to the headers.
+ *
+ * @param next end of the line, after its newline
+ * @return false if the name is not valid or there are too many headers
+ */
+static bool header_split(headers_t *headers, char *line, char *next) {
+    char *eol = next - 1;
+    if (eol > line && eol[-1] == '\r') {
+        eol--;
+    }
+    // the name is a token, ended by the colon
+    char *colon = (char *)scan_span(line, eol, scan_token_set());
+    if (colon == line || colon == eol || *colon != ':' ||
+        headers->cnt == HEADERS_MAX) {
+        return false;
+    }
+    char *value = colon + 1;
+    while (value < eol && is_ows(*value)) {
+        value++;
+    }
+    char *value_end = eol;
+    while (value_end > value && is_ows(value_end[-1])) {
+        value_end--;
+    }
+    header_slice_t *hdr = &headers->hdrs[headers->cnt++];
+    hdr->name = line;
+    hdr->name_len = colon - line;
+    hdr->value = value;
+    hdr->value_len = value_end - value;
+    hdr->id = header_id(line, hdr->name_len);
+    *colon = '\0';
+    *value_end = '\0';
+    return true;
+}
+/**
+ * @brief Read the rest of a header block that does not fit in the read
+ * buffer, copying it into the arena line by line.
+ */
+static int headers_read_lines(rio_t *rp, headers_t *headers,
+                              arena_t *arena) {
+    while (1) {
+        char *line;
+        ssize_t n = rio_peeklineb(rp, &line);
+        // cut by EOF, or a line longer than the read buffer
+        if (n <= 0 || line[n - 1] != '\n') {
+            return -1;
+        }
+        if (n == 2 && !memcmp(line, "\r\n", 2)) {
+            rio_consumeb(rp, n);
+            return headers->cnt;
+        }
+        char *copy = arena_strndup(arena, line, n);
+        if (copy == NULL) {
+            return -1;
+        }
+        rio_consumeb(rp, n);
+        if (!header_split(headers, copy, copy + n)) {
+            return -1;
+        }
+    }
+}
+/**
+ * @brief Read the header block of a request and split it into headers.
+ */
+int headers_read(rio_t *rp, headers_t *headers, arena_t *arena) {
+    char *block;
+    headers->cnt = 0;
+    // a request without headers only has the empty line
+    ssize_t n = rio_peeklineb(rp, &block);
+    if (n <= 0) {
+        return -1;
+    }
+    if (n == 2 && !memcmp(block, "\r\n", 2)) {
+        rio_consumeb(rp, n);
+        return 0;
+    }
+    n = rio_peekb(rp, END_OF_HEADERS, &block);
+    if (n < 3) {
+        return -1;
+    }
+    if (memcmp(block + n - 3, END_OF_HEADERS, 3)) {
+        // a large block, such as one with big cookies, or one cut by EOF
+        return headers_read_lines(rp, headers, arena);
+    }
+    char *end = block + n - 2; // the empty line
+    char *line = block;
+    while (line < end) {
+        char *next = memchr(line, '\n', end - line) + 1; // end is after one
+        if (!header_split(headers, line, next)) {
+            return -1;
+        }
+        line = next;
+    }
+    rio_consumeb(rp, n);
+    return headers->cnt;
+}
+/**
+ * @brief Find the first header with a standard name.
+ */
+const header_slice_t *headers_find(const headers_t *headers, header_id_t id) {
+    for (int i = 0; i < headers->cnt; i++) {
+        if (headers->hdrs[i].id == id) {
+            return &headers->hdrs[i];
+        }
+    }
+    return NULL;
+}
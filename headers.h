@@ -0,0 +1,55 @@
+/**
+ * @file headers.h
+ * @author Xianwei Zou
+ * @brief Zero-copy tokenizer of request headers.
+ *
+ * The header block of a request is peeked in the rio read buffer of the
+ * client and split in place in a single pass: each name and value is null
+ * terminated where its ':' or line end was, so headers are slices of the
+ * buffer with the shape of the header_t of http_parser.h. They stay valid
+ * until the next read on the client, which for a GET request never comes.
+ * A block too large for the buffer (big cookies, for example) is instead
+ * copied line by line into the request arena and split there.
+ */
+#ifndef HEADERS_H
+#define HEADERS_H
+#include "arena.h"
+#include "csapp.h"
+#include "header_id.h"
+#include <stdbool.h>
+#include <stddef.h>
+/* Max number of headers in a request */
+#define HEADERS_MAX 64
+/* A header inside the read buffer, a header_t with lengths */
+typedef struct {
+    const char *name;  // null terminated, without the colon
+    const char *value; // null terminated, without surrounding whitespace
+    size_t name_len;
+    size_t value_len;
+    header_id_t id; // HDR_UNKNOWN for non-standard names
+} header_slice_t;
+/* Headers of a request, in the order they were received */
+typedef struct {
+    header_slice_t hdrs[HEADERS_MAX];
+    int cnt;
+} headers_t;
+/**
+ * @brief Read the header block of a request, up to and including the empty
+ * line, and split it into headers.
+ *
+ * A block that does not fit in the read buffer (RIO_BUFSIZE bytes) is
+ * copied line by line into the arena, each line of which must fit.
+ *
+ * @param arena where a large block is copied, until the request ends
+ * @return number of headers, or -1 if the block is cut by EOF, has a line
+ * longer than the buffer, more than HEADERS_MAX headers or a line without a
+ * valid name
+ */
+int headers_read(rio_t *rp, headers_t *headers, arena_t *arena);
+/**
+ * @brief Find the first header with a standard name.
+ *
+ * @return the header, or NULL if there is none
+ */
+const header_slice_t *headers_find(const headers_t *headers, header_id_t id);
+#endif /* HEADERS_H */
@@ -0,0 +1,302 @@
+/**
+ * @file http_parser.c
+ * @author Xianwei Zou
+ * @brief In-tree implementation of the http_parser.h API.
+ *
+ * Each line is parsed in a single pass by hand, without regular
+ * expressions; methods and header names are validated with the vectorized
+ * scans of scan.h. The parser and everything it returns (the fields of the
+ * request line, header_t structs and their strings) live in an arena.h
+ * arena: the caller's with parser_new_in(), whose memory is released with
+ * the rest of the request, or one owned by the parser with parser_new(),
+ * whose first chunk is allocated with the parser_t, so that a typical
+ * request makes a single malloc(). Nothing is freed before the arena is
+ * reset, so returned pointers stay valid until then.
+ */
+#include "http_parser.h"
+#include "arena.h"
+#include "scan.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+// Size of the first chunk of the arena of parser_new()
+#define ARENA_INLINE 2048
+// Min size of the chunks chained after it
+#define ARENA_CHUNK (2 * PARSER_MAXLINE)
+/* A parsed header, in the order received */
+typedef struct header_node {
+    header_t hdr; // first, so that a node is returned as its header_t
+    struct header_node *next;
+} header_node_t;
+struct parser {
+    bool parsed_request;                  // the request line was parsed
+    const char *values[HTTP_VERSION + 1]; // fields of the request line
+    header_node_t *head;                  // headers, in the order received
+    header_node_t **tail;                 // where the next header is linked
+    header_node_t *iter;                  // next header to iterate over
+    bool iter_done;                       // the iterator reached the end
+    arena_t *arena;                       // where everything is allocated
+    bool owns_arena;                      // from parser_new()
+};
+/* A parser of parser_new(), allocated with its arena */
+typedef struct {
+    parser_t parser;
+    arena_t arena;
+    char first[ARENA_INLINE] __attribute__((aligned(ARENA_ALIGN)));
+} owning_parser_t;
+/**
+ * @brief Initialize a parser allocated in an arena.
+ */
+static void parser_init(parser_t *p, arena_t *arena, bool owns_arena) {
+    p->parsed_request = false;
+    memset(p->values, 0, sizeof(p->values));
+    p->head = NULL;
+    p->tail = &p->head;
+    p->iter = NULL;
+    p->iter_done = false;
+    p->arena = arena;
+    p->owns_arena = owns_arena;
+}
+/**
+ * @brief Initialize a parser with its own arena.
+ */
+parser_t *parser_new(void) {
+    owning_parser_t *op = malloc(sizeof(owning_parser_t));
+    if (op == NULL) {
+        return NULL;
+    }
+    arena_init(&op->arena, op->first, ARENA_INLINE, ARENA_CHUNK);
+    parser_init(&op->parser, &op->arena, true);
+    return &op->parser;
+}
+/**
+ * @brief Initialize a parser in the caller's arena.
+ */
+parser_t *parser_new_in(arena_t *arena) {
+    parser_t *p = arena_alloc(arena, sizeof(parser_t));
+    if (p != NULL) {
+        parser_init(p, arena, false);
+    }
+    return p;
+}
+/**
+ * @brief Destroy a parser and everything it returned.
+ */
+void parser_free(parser_t *p) {
+    if (p == NULL || !p->owns_arena) {
+        return; // released with the caller's arena
+    }
+    arena_reset(p->arena);
+    free(p); // the owning_parser_t, which starts with it
+}
+/**
+ * @brief Check if a character is optional whitespace around a value.
+ */
+static bool is_ows(char c) {
+    return c == ' ' || c == '\t';
+}
+/**
+ * @brief Find the end of a line, without its "\r\n" or "\n".
+ */
+static const char *line_end(const char *line) {
+    const char *end = line + strlen(line);
+    if (end > line && end[-1] == '\n') {
+        end--;
+        if (end > line && end[-1] == '\r') {
+            end--;
+        }
+    }
+    return end;
+}
+/**
+ * @brief Store a field of the request line.
+ *
+ * @return false if out of memory
+ */
+static bool store_value(parser_t *p, parser_value_type type, const char *s,
+                        size_t len) {
+    return (p->values[type] = arena_strndup(p->arena, s, len)) != NULL;
+}
+/**
+ * @brief Parse a request line, e.g.
+ * "GET http://host:port/path HTTP/1.0".
+ */
+static parser_state parse_request(parser_t *p, const char *s,
+                                  const char *end) {
+    // method, a token
+    const char *method = s;
+    s = scan_span(s, end, scan_token_set());
+    if (s == method || s == end || *s != ' ') {
+        return ERROR;
+    }
+    const char *method_end = s++;
+    // absolute URI: scheme "://" host [":" port] [path], up to a space
+    const char *uri = s;
+    const char *uri_end = memchr(uri, ' ', end - uri);
+    if (uri_end == NULL) {
+        return ERROR;
+    }
+    while (s < uri_end && (isalnum((unsigned char)*s) || *s == '+' ||
+                           *s == '-' || *s == '.')) {
+        s++;
+    }
+    const char *scheme_end = s;
+    if (scheme_end == uri || uri_end - s < 3 || memcmp(s, "://", 3)) {
+        return ERROR;
+    }
+    s += 3;
+    const char *host = s;
+    while (s < uri_end && *s != ':' && *s != '/') {
+        s++;
+    }
+    const char *host_end = s;
+    if (host_end == host) {
+        return ERROR;
+    }
+    const char *port = "80", *port_end = port + 2;
+    if (s < uri_end && *s == ':') {
+        port = ++s;
+        while (s < uri_end && isdigit((unsigned char)*s)) {
+            s++;
+        }
+        port_end = s;
+        if (port_end == port) {
+            return ERROR;
+        }
+    }
+    const char *path = "/", *path_end = path + 1;
+    if (s < uri_end) {
+        if (*s != '/') {
+            return ERROR;
+        }
+        path = s;
+        path_end = uri_end;
+    }
+    s = uri_end;
+    // " HTTP/" version
+    if (end - s < 6 || memcmp(s, " HTTP/", 6)) {
+        return ERROR;
+    }
+    s += 6;
+    const char *version = s;
+    if (end - s != 3 || !isdigit((unsigned char)s[0]) || s[1] != '.' ||
+        !isdigit((unsigned char)s[2])) {
+        return ERROR;
+    }
+    if (!store_value(p, METHOD, method, method_end - method) ||
+        !store_value(p, URI, uri, uri_end - uri) ||
+        !store_value(p, SCHEME, uri, scheme_end - uri) ||
+        !store_value(p, HOST, host, host_end - host) ||
+        !store_value(p, PORT, port, port_end - port) ||
+        !store_value(p, PATH, path, path_end - path) ||
+        !store_value(p, HTTP_VERSION, version, 3)) {
+        return ERROR;
+    }
+    p->parsed_request = true;
+    return REQUEST;
+}
+/**
+ * @brief Parse a header line, e.g. "Connection: close".
+ */
+static parser_state parse_header(parser_t *p, const char *s,
+                                 const char *end) {
+    // the name is a token, ended by the colon
+    const char *colon = scan_span(s, end, scan_token_set());
+    if (colon == s || colon == end || *colon != ':') {
+        return ERROR;
+    }
+    const char *value = colon + 1, *value_end = end;
+    while (value < value_end && is_ows(*value)) {
+        value++;
+    }
+    while (value_end > value && is_ows(value_end[-1])) {
+        value_end--;
+    }
+    // the node and both strings in one allocation
+    size_t name_len = colon - s, value_len = value_end - value;
+    header_node_t *node =
+        arena_alloc(p->arena, sizeof(header_node_t) + name_len + value_len + 2);
+    if (node == NULL) {
+        return ERROR;
+    }
+    char *name_copy = (char *)(node + 1);
+    char *value_copy = name_copy + name_len + 1;
+    memcpy(name_copy, s, name_len);
+    name_copy[name_len] = '\0';
+    memcpy(value_copy, value, value_len);
+    value_copy[value_len] = '\0';
+    node->hdr.name = name_copy;
+    node->hdr.value = value_copy;
+    node->next = NULL;
+    *p->tail = node;
+    p->tail = &node->next;
+    // an iterator that reached the end resumes with the new header
+    if (p->iter_done) {
+        p->iter = node;
+        p->iter_done = false;
+    }
+    return HEADER;
+}
+/**
+ * @brief Parse a line of an HTTP request, which is the request line if none
+ * was parsed yet, and a header otherwise.
+ */
+parser_state parser_parse_line(parser_t *p, const char *line) {
+    if (p == NULL || line == NULL) {
+        return ERROR;
+    }
+    const char *end = line_end(line);
+    return p->parsed_request ? parse_header(p, line, end)
+                             : parse_request(p, line, end);
+}
+/**
+ * @brief Retrieve a field of the request line.
+ */
+int parser_retrieve(parser_t *p, parser_value_type type, const char **val) {
+    if (p == NULL || val == NULL || type < METHOD || type > HTTP_VERSION) {
+        return -1;
+    }
+    if (!p->parsed_request) {
+        return -2;
+    }
+    *val = p->values[type];
+    return 0;
+}
+/**
+ * @brief Find the first header with a name, compared case-insensitively.
+ */
+header_t *parser_lookup_header(parser_t *p, const char *name) {
+    if (p == NULL || name == NULL) {
+        return NULL;
+    }
+    for (header_node_t *node = p->head; node != NULL; node = node->next) {
+        if (!strcasecmp(node->hdr.name, name)) {
+            return &node->hdr;
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief Iterate over the headers, in the order they were parsed.
+ */
+header_t *parser_retrieve_next_header(parser_t *p) {
+    if (p == NULL) {
+        return NULL;
+    }
+    if (p->iter == NULL && !p->iter_done) {
+        p->iter = p->head; // first call
+    }
+    header_node_t *node = p->iter;
+    if (node == NULL) {
+        p->iter_done = true;
+        return NULL;
+    }
+    p->iter = node->next;
+    if (p->iter == NULL) {
+        p->iter_done = true;
+    }
+    return &node->hdr;
+}
@@ -17,6 +17,8 @@
 #ifndef __HTTP_PARSER_H__
 #define __HTTP_PARSER_H__
 
+#include "arena.h"
+
 #define MAXNAME 256
 #define PARSER_MAXLINE 4096
 
@@ -74,6 +76,17 @@ typedef enum parser_value {
  */
 parser_t *parser_new(void);
 
+/**
+ * @brief Initialize a parser in the caller's arena
+ *
+ * The parser and everything it returns are allocated from the arena and
+ * stay valid until arena_reset(); parser_free() on it does nothing.
+ *
+ * @param[in] arena The arena of the request
+ * @return The parser, or NULL if out of memory
+ */
+parser_t *parser_new_in(arena_t *arena);
+
 /**
  * @brief Destroy a parser
  *
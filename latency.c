@@ -0,0 +1,181 @@
+/**
+ * @file latency.c
+ * @author Xianwei Zou
+ * @brief Latency histograms of the phases of a request.
+ */
+#include "latency.h"
+#include "metrics.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+/* Histograms of the threads using a slot, on their own cache lines */
+typedef struct {
+    uint64_t count[PHASE_CNT][LATENCY_BUCKETS];
+    uint64_t sum[PHASE_CNT]; // total duration in ns
+} __attribute__((aligned(64))) latency_slot_t;
+static const char *phase_names[PHASE_CNT] = {
+    [PHASE_REQUEST_LINE] = "request_line",
+    [PHASE_HEADERS] = "headers",
+    [PHASE_CACHE_LOOKUP] = "cache_lookup",
+    [PHASE_CONNECT] = "connect",
+    [PHASE_FIRST_BYTE] = "first_byte",
+    [PHASE_TRANSFER] = "transfer",
+    [PHASE_CACHE_INSERT] = "cache_insert",
+};
+static latency_slot_t slots[LATENCY_SLOTS];
+static unsigned next_slot = 0;   // slot of the next new thread, wraps
+static __thread int my_slot = -1; // slot of the calling thread
+/**
+ * @brief Get the current time in nanoseconds.
+ */
+uint64_t latency_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/**
+ * @brief Find the bucket of a duration.
+ */
+int latency_bucket(uint64_t ns) {
+    if (ns < LATENCY_SUB_BUCKETS) {
+        return (int)ns;
+    }
+    int exp = 63 - __builtin_clzll(ns);
+    int sub = (int)(ns >> (exp - LATENCY_SUB_BITS)) - LATENCY_SUB_BUCKETS;
+    int index = (exp - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+    return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+/**
+ * @brief Find the smallest duration of a bucket.
+ */
+static uint64_t bucket_start(int index) {
+    if (index < LATENCY_SUB_BUCKETS) {
+        return index;
+    }
+    int exp = index / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+    uint64_t sub = index % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+    return sub << (exp - LATENCY_SUB_BITS);
+}
+/**
+ * @brief Record the duration of a phase that started at start.
+ */
+void latency_record(latency_phase_t phase, uint64_t start) {
+    uint64_t ns = latency_now() - start;
+    if (my_slot < 0) {
+        my_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) %
+                  LATENCY_SLOTS;
+    }
+    latency_slot_t *slot = &slots[my_slot];
+    __atomic_fetch_add(&slot->count[phase][latency_bucket(ns)], 1,
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->sum[phase], ns, __ATOMIC_RELAXED);
+}
+/**
+ * @brief Add a duration to a histogram.
+ */
+void latency_hist_add(latency_hist_t *hist, uint64_t ns) {
+    hist->count[latency_bucket(ns)]++;
+    hist->total++;
+    hist->sum += ns;
+}
+/**
+ * @brief Sum the histogram of a phase over all slots.
+ */
+static void collect(latency_phase_t phase, latency_hist_t *hist) {
+    memset(hist, 0, sizeof(*hist));
+    for (int i = 0; i < LATENCY_SLOTS; i++) {
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            uint64_t n =
+                __atomic_load_n(&slots[i].count[phase][b], __ATOMIC_RELAXED);
+            hist->count[b] += n;
+            hist->total += n;
+        }
+        hist->sum += __atomic_load_n(&slots[i].sum[phase], __ATOMIC_RELAXED);
+    }
+}
+/**
+ * @brief Find a percentile of a histogram, as the end of its bucket.
+ */
+uint64_t latency_percentile(const latency_hist_t *hist, double pct) {
+    uint64_t rank = (uint64_t)(hist->total * pct / 100.0);
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += hist->count[b];
+        if (seen > rank) {
+            return b + 1 < LATENCY_BUCKETS ? bucket_start(b + 1) : UINT64_MAX;
+        }
+    }
+    return 0;
+}
+/**
+ * @brief Append the samples of a histogram in the Prometheus text format.
+ * Buckets are exported at powers of 4 from 1.024 us to 17 s, which are
+ * bucket boundaries, so the exported counts are exact.
+ */
+void latency_hist_render(char *buf, size_t len, size_t *used,
+                         const char *family, const char *labels,
+                         const latency_hist_t *hist) {
+    uint64_t cumulative = 0;
+    int b = 0;
+    for (int shift = 10; shift <= 34; shift += 2) {
+        for (; b < latency_bucket((uint64_t)1 << shift); b++) {
+            cumulative += hist->count[b];
+        }
+        metrics_printf(buf, len, used,
+                       "%s_bucket{%s,le=\"%.10g\"} %" PRIu64 "\n", family,
+                       labels, (double)((uint64_t)1 << shift) / 1e9,
+                       cumulative);
+    }
+    metrics_printf(buf, len, used, "%s_bucket{%s,le=\"+Inf\"} %" PRIu64 "\n",
+                   family, labels, hist->total);
+    metrics_printf(buf, len, used, "%s_sum{%s} %.9f\n", family, labels,
+                   hist->sum / 1e9);
+    metrics_printf(buf, len, used, "%s_count{%s} %" PRIu64 "\n", family,
+                   labels, hist->total);
+}
+/**
+ * @brief Append the histograms in the Prometheus text format.
+ */
+size_t latency_render(char *buf, size_t len) {
+    static latency_hist_t hist; // too big for the stack of a thread
+    static pthread_mutex_t renderLock = PTHREAD_MUTEX_INITIALIZER;
+    size_t used = 0;
+    pthread_mutex_lock(&renderLock);
+    metrics_printf(buf, len, &used,
+                   "# HELP proxy_phase_seconds Duration of request phases.\n"
+                   "# TYPE proxy_phase_seconds histogram\n");
+    for (int phase = 0; phase < PHASE_CNT; phase++) {
+        char labels[64];
+        snprintf(labels, sizeof(labels), "phase=\"%s\"", phase_names[phase]);
+        collect(phase, &hist);
+        latency_hist_render(buf, len, &used, "proxy_phase_seconds", labels,
+                            &hist);
+    }
+    pthread_mutex_unlock(&renderLock);
+    return used;
+}
+/**
+ * @brief Print the count and percentiles of each phase.
+ */
+void latency_dump(FILE *fp) {
+    static latency_hist_t hist;
+    static pthread_mutex_t dumpLock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&dumpLock);
+    fprintf(fp, "%-13s %10s %10s %10s %10s %10s %10s\n", "phase (us)",
+            "count", "mean", "p50", "p90", "p99", "p99.9");
+    for (int phase = 0; phase < PHASE_CNT; phase++) {
+        collect(phase, &hist);
+        double mean = hist.total ? hist.sum / 1e3 / hist.total : 0;
+        fprintf(fp, "%-13s %10" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                phase_names[phase], hist.total, mean,
+                latency_percentile(&hist, 50) / 1e3,
+                latency_percentile(&hist, 90) / 1e3,
+                latency_percentile(&hist, 99) / 1e3,
+                latency_percentile(&hist, 99.9) / 1e3);
+    }
+    fflush(fp);
+    pthread_mutex_unlock(&dumpLock);
+}
@@ -0,0 +1,87 @@
+/**
+ * @file latency.h
+ * @author Xianwei Zou
+ * @brief Latency histograms of the phases of a request.
+ *
+ * Each phase of doit() records its duration in a log-linear histogram:
+ * every power of two is split into LATENCY_SUB_BUCKETS buckets, so any
+ * value is known within 12.5% from 1 ns to 2^40 ns (about 18 minutes), as
+ * in HDR histograms. Longer values are counted in the last bucket.
+ * Histograms are kept in per-thread slots updated with relaxed atomic adds,
+ * like the counters of metrics.h, and summed when they are reported.
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+// Buckets per power of two, as a power of two
+#define LATENCY_SUB_BITS 3
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+// Number of buckets, covering durations up to 2^40 ns
+#define LATENCY_BUCKETS ((40 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+// Number of histogram slots, threads beyond this share slots
+#define LATENCY_SLOTS 16
+// Histogram of durations
+typedef struct {
+    uint64_t count[LATENCY_BUCKETS]; // number of values in each bucket
+    uint64_t total;                  // number of values
+    uint64_t sum;                    // total duration in ns
+} latency_hist_t;
+// Phases of a request
+typedef enum {
+    PHASE_REQUEST_LINE, // reading the request line from the client
+    PHASE_HEADERS,      // reading the request headers
+    PHASE_CACHE_LOOKUP, // finding the key in the cache, with lock waits
+    PHASE_CONNECT,      // resolving and connecting to the server
+    PHASE_FIRST_BYTE,   // from sending the request to the first byte back
+    PHASE_TRANSFER,     // from sending the request to the last byte back
+    PHASE_CACHE_INSERT, // inserting the response into the cache
+    PHASE_CNT
+} latency_phase_t;
+/**
+ * @brief Get the current time in nanoseconds, for latency_record().
+ */
+uint64_t latency_now();
+/**
+ * @brief Record the duration of a phase that started at start.
+ *
+ * @param start time returned by latency_now() when the phase started
+ */
+void latency_record(latency_phase_t phase, uint64_t start);
+/**
+ * @brief Find the bucket of a duration in a histogram.
+ */
+int latency_bucket(uint64_t ns);
+/**
+ * @brief Add a duration to a histogram. The caller serializes updates.
+ */
+void latency_hist_add(latency_hist_t *hist, uint64_t ns);
+/**
+ * @brief Find a percentile of a histogram, as the end of its bucket.
+ *
+ * @param pct percentile between 0 and 100
+ * @return the percentile in ns
+ */
+uint64_t latency_percentile(const latency_hist_t *hist, double pct);
+/**
+ * @brief Append the samples of a histogram in the Prometheus text format,
+ * without the HELP and TYPE lines of its family.
+ *
+ * @param labels labels of the samples, e.g. phase="connect"
+ * @param[in,out] used bytes already used in buf
+ */
+void latency_hist_render(char *buf, size_t len, size_t *used,
+                         const char *family, const char *labels,
+                         const latency_hist_t *hist);
+/**
+ * @brief Append the histograms in the Prometheus text format.
+ *
+ * @return number of bytes written, at most len
+ */
+size_t latency_render(char *buf, size_t len);
+/**
+ * @brief Print the count and percentiles of each phase.
+ */
+void latency_dump(FILE *fp);
+#endif /* LATENCY_H */
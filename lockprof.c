@@ -0,0 +1,186 @@
+/**
+ * @file lockprof.c
+ * @author Xianwei Zou
+ * @brief Contention profiling of the proxy's mutexes.
+ */
+#include "lockprof.h"
+#include "metrics.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* Registered mutexes, set up at startup */
+static prof_mutex_t *mutexes[LOCKPROF_MAX];
+static int mutex_cnt = 0;
+/* Copy of a mutex's statistics being reported */
+static prof_mutex_t snapshot;
+static pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * @brief Initialize a profiled mutex and register it for reports.
+ */
+void prof_mutex_init(prof_mutex_t *m, const char *name) {
+    memset(m, 0, sizeof(*m));
+    pthread_mutex_init(&m->mutex, NULL);
+    m->name = name;
+    if (mutex_cnt < LOCKPROF_MAX) {
+        mutexes[mutex_cnt++] = m;
+    }
+}
+/**
+ * @brief Find the statistics of a call site, adding it on first use.
+ * The mutex must be held.
+ *
+ * @return the site, or NULL if too many sites are tracked
+ */
+static lockprof_site_t *find_site(prof_mutex_t *m, const char *site) {
+    for (int i = 0; i < m->site_cnt; i++) {
+        if (m->sites[i].site == site) {
+            return &m->sites[i];
+        }
+    }
+    if (m->site_cnt == LOCKPROF_SITES) {
+        return NULL;
+    }
+    lockprof_site_t *entry = &m->sites[m->site_cnt++];
+    entry->site = site;
+    return entry;
+}
+/**
+ * @brief Lock a profiled mutex.
+ */
+void prof_mutex_lock_at(prof_mutex_t *m, const char *site) {
+    uint64_t start = latency_now();
+    bool contended = pthread_mutex_trylock(&m->mutex) != 0;
+    if (contended) {
+        pthread_mutex_lock(&m->mutex);
+    }
+    // the statistics are protected by the mutex itself
+    m->locked_at = contended ? latency_now() : start;
+    uint64_t wait = m->locked_at - start;
+    m->acquired++;
+    latency_hist_add(&m->wait, wait);
+    lockprof_site_t *entry = find_site(m, site);
+    if (entry != NULL) {
+        entry->acquired++;
+        entry->wait += wait;
+    }
+    if (contended) {
+        m->contended++;
+        if (entry != NULL) {
+            entry->contended++;
+        }
+    }
+}
+/**
+ * @brief Unlock a profiled mutex, recording the hold time.
+ */
+void prof_mutex_unlock(prof_mutex_t *m) {
+    latency_hist_add(&m->hold, latency_now() - m->locked_at);
+    pthread_mutex_unlock(&m->mutex);
+}
+/**
+ * @brief Wait on a condition variable with a profiled mutex held, until a
+ * deadline.
+ */
+int prof_cond_timedwait(pthread_cond_t *cond, prof_mutex_t *m,
+                        const struct timespec *deadline) {
+    latency_hist_add(&m->hold, latency_now() - m->locked_at);
+    int err = pthread_cond_timedwait(cond, &m->mutex, deadline);
+    m->locked_at = latency_now();
+    return err;
+}
+/**
+ * @brief Copy the statistics of a mutex into snapshot.
+ * reportLock must be held.
+ */
+static void take_snapshot(prof_mutex_t *m) {
+    pthread_mutex_lock(&m->mutex);
+    memcpy(&snapshot, m, sizeof(snapshot));
+    pthread_mutex_unlock(&m->mutex);
+}
+/**
+ * @brief Append the statistics of all mutexes in the Prometheus text format.
+ */
+size_t lockprof_render(char *buf, size_t len) {
+    size_t used = 0;
+    char labels[64];
+    pthread_mutex_lock(&reportLock);
+    metrics_printf(buf, len, &used,
+                   "# HELP proxy_lock_acquisitions_total Mutex acquisitions."
+                   "\n# TYPE proxy_lock_acquisitions_total counter\n");
+    for (int i = 0; i < mutex_cnt; i++) {
+        take_snapshot(mutexes[i]);
+        metrics_printf(buf, len, &used,
+                       "proxy_lock_acquisitions_total{lock=\"%s\"} %" PRIu64
+                       "\n",
+                       snapshot.name, snapshot.acquired);
+    }
+    metrics_printf(buf, len, &used,
+                   "# HELP proxy_lock_contended_total Mutex acquisitions that"
+                   " had to wait.\n"
+                   "# TYPE proxy_lock_contended_total counter\n");
+    for (int i = 0; i < mutex_cnt; i++) {
+        take_snapshot(mutexes[i]);
+        metrics_printf(buf, len, &used,
+                       "proxy_lock_contended_total{lock=\"%s\"} %" PRIu64 "\n",
+                       snapshot.name, snapshot.contended);
+    }
+    metrics_printf(buf, len, &used,
+                   "# HELP proxy_lock_wait_seconds Time waiting for mutexes.\n"
+                   "# TYPE proxy_lock_wait_seconds histogram\n");
+    for (int i = 0; i < mutex_cnt; i++) {
+        take_snapshot(mutexes[i]);
+        snprintf(labels, sizeof(labels), "lock=\"%s\"", snapshot.name);
+        latency_hist_render(buf, len, &used, "proxy_lock_wait_seconds",
+                            labels, &snapshot.wait);
+    }
+    metrics_printf(buf, len, &used,
+                   "# HELP proxy_lock_hold_seconds Time holding mutexes.\n"
+                   "# TYPE proxy_lock_hold_seconds histogram\n");
+    for (int i = 0; i < mutex_cnt; i++) {
+        take_snapshot(mutexes[i]);
+        snprintf(labels, sizeof(labels), "lock=\"%s\"", snapshot.name);
+        latency_hist_render(buf, len, &used, "proxy_lock_hold_seconds",
+                            labels, &snapshot.hold);
+    }
+    pthread_mutex_unlock(&reportLock);
+    return used;
+}
+/**
+ * @brief Order call sites by decreasing total wait time.
+ */
+static int site_compare(const void *a, const void *b) {
+    const lockprof_site_t *x = a;
+    const lockprof_site_t *y = b;
+    return x->wait < y->wait ? 1 : x->wait > y->wait ? -1 : 0;
+}
+/**
+ * @brief Print the statistics of all mutexes and their most contended call
+ * sites.
+ */
+void lockprof_dump(FILE *fp) {
+    pthread_mutex_lock(&reportLock);
+    for (int i = 0; i < mutex_cnt; i++) {
+        take_snapshot(mutexes[i]);
+        fprintf(fp,
+                "lock %s: %" PRIu64 " acquisitions, %" PRIu64 " contended,"
+                " wait p99 %.1f us, hold p99 %.1f us\n",
+                snapshot.name, snapshot.acquired, snapshot.contended,
+                latency_percentile(&snapshot.wait, 99) / 1e3,
+                latency_percentile(&snapshot.hold, 99) / 1e3);
+        qsort(snapshot.sites, snapshot.site_cnt, sizeof(lockprof_site_t),
+              site_compare);
+        for (int j = 0; j < snapshot.site_cnt && j < LOCKPROF_TOP; j++) {
+            lockprof_site_t *site = &snapshot.sites[j];
+            fprintf(fp,
+                    "  %-20s %10" PRIu64 " acquisitions %10" PRIu64
+                    " contended %12.1f us waited\n",
+                    site->site, site->acquired, site->contended,
+                    site->wait / 1e3);
+        }
+    }
+    fflush(fp);
+    pthread_mutex_unlock(&reportLock);
+}
@@ -0,0 +1,87 @@
+/**
+ * @file lockprof.h
+ * @author Xianwei Zou
+ * @brief Contention profiling of the proxy's mutexes.
+ *
+ * A prof_mutex_t is a pthread mutex that counts its acquisitions and keeps
+ * histograms of the time spent waiting for it and holding it, plus the
+ * call sites that wait the most. A lock is first tried without waiting, so
+ * an uncontended acquisition only adds two clock reads. The statistics are
+ * updated while the mutex is held, so they need no lock of their own.
+ */
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+#include "latency.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+// Max number of call sites tracked per mutex
+#define LOCKPROF_SITES 32
+// Max number of profiled mutexes
+#define LOCKPROF_MAX 8
+// Number of call sites printed by lockprof_dump()
+#define LOCKPROF_TOP 5
+// Statistics of the acquisitions of a mutex from one call site
+typedef struct {
+    const char *site;   // "file:line" of the lock call
+    uint64_t acquired;  // number of acquisitions
+    uint64_t contended; // acquisitions that had to wait
+    uint64_t wait;      // total wait time in ns
+} lockprof_site_t;
+// Profiled mutex
+typedef struct {
+    pthread_mutex_t mutex;
+    const char *name;                      // name used in reports
+    uint64_t acquired;                     // number of acquisitions
+    uint64_t contended;                    // acquisitions that had to wait
+    latency_hist_t wait;                   // time waiting to acquire
+    latency_hist_t hold;                   // time between lock and unlock
+    uint64_t locked_at;                    // time of the last acquisition
+    lockprof_site_t sites[LOCKPROF_SITES]; // call sites, by first use
+    int site_cnt;                          // number of call sites
+} prof_mutex_t;
+#define LOCKPROF_STR(x) #x
+#define LOCKPROF_SITE(file, line) file ":" LOCKPROF_STR(line)
+/**
+ * @brief Lock a profiled mutex, recording the call site.
+ */
+#define prof_mutex_lock(m)                                                     \
+    prof_mutex_lock_at((m), LOCKPROF_SITE(__FILE__, __LINE__))
+/**
+ * @brief Initialize a profiled mutex and register it for reports.
+ *
+ * @param name name used in reports, e.g. "cache"
+ */
+void prof_mutex_init(prof_mutex_t *m, const char *name);
+/**
+ * @brief Lock a profiled mutex. Use prof_mutex_lock() instead.
+ *
+ * @param site call site of the lock
+ */
+void prof_mutex_lock_at(prof_mutex_t *m, const char *site);
+/**
+ * @brief Unlock a profiled mutex, recording the hold time.
+ */
+void prof_mutex_unlock(prof_mutex_t *m);
+/**
+ * @brief Wait on a condition variable with a profiled mutex held, until a
+ * deadline on the clock of the condition variable. The time spent waiting
+ * is not counted as holding the mutex.
+ *
+ * @return 0, or ETIMEDOUT if the deadline passed
+ */
+int prof_cond_timedwait(pthread_cond_t *cond, prof_mutex_t *m,
+                        const struct timespec *deadline);
+/**
+ * @brief Append the statistics of all mutexes in the Prometheus text format.
+ *
+ * @return number of bytes written, at most len
+ */
+size_t lockprof_render(char *buf, size_t len);
+/**
+ * @brief Print the statistics of all mutexes and their most contended call
+ * sites.
+ */
+void lockprof_dump(FILE *fp);
+#endif /* LOCKPROF_H */
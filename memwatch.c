@@ -0,0 +1,204 @@
+/**
+ * @file memwatch.c
+ * @author Xianwei Zou
+ * @brief Sizing of the cache budget by memory limit and pressure.
+ */
+#include "memwatch.h"
+#include "cache.h"
+#include "csapp.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+/* A sample of the memory of the proxy */
+typedef struct {
+    size_t limit;    // memory the proxy may use
+    size_t used;     // memory in use
+    double pressure; // % of time stalled on memory over the last 10 s
+} mem_sample_t;
+// Mount points of the cgroup v2 hierarchy, alone or next to v1
+static const char *CGROUP_ROOTS[] = {"/sys/fs/cgroup",
+                                     "/sys/fs/cgroup/unified"};
+static char cgroup_root[MAXLINE]; // mount point of the hierarchy, or ""
+static char cgroup_dir[MAXLINE];  // directory of the proxy's cgroup, or ""
+/**
+ * @brief Read the first line of a file.
+ *
+ * @return false if the file cannot be read
+ */
+static bool read_first_line(const char *dir, const char *name, char *buf,
+                            size_t len) {
+    char path[MAXLINE];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = fgets(buf, len, fp) != NULL;
+    fclose(fp);
+    return ok;
+}
+/**
+ * @brief Read a file holding a byte count.
+ *
+ * @return false if the file cannot be read or holds "max"
+ */
+static bool read_bytes(const char *dir, const char *name, size_t *bytes) {
+    char buf[MAXLINE];
+    char *end;
+    if (!read_first_line(dir, name, buf, sizeof(buf))) {
+        return false;
+    }
+    unsigned long long value = strtoull(buf, &end, 10);
+    if (end == buf) {
+        return false;
+    }
+    *bytes = (size_t)value;
+    return true;
+}
+/**
+ * @brief Find the cgroup v2 directory of the proxy, from the "0::" line of
+ * /proc/self/cgroup.
+ */
+static void find_cgroup() {
+    char line[MAXLINE];
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    if (fp == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "0::", 3)) {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        const char *path = strcmp(line + 3, "/") ? line + 3 : "";
+        for (size_t i = 0; i < sizeof(CGROUP_ROOTS) / sizeof(char *); i++) {
+            char buf[MAXLINE];
+            if (read_first_line(CGROUP_ROOTS[i], "cgroup.controllers", buf,
+                                sizeof(buf))) {
+                snprintf(cgroup_root, sizeof(cgroup_root), "%s",
+                         CGROUP_ROOTS[i]);
+                snprintf(cgroup_dir, sizeof(cgroup_dir), "%s%s",
+                         CGROUP_ROOTS[i], path);
+                break;
+            }
+        }
+        break;
+    }
+    fclose(fp);
+}
+/**
+ * @brief Get the lowest memory.max of the proxy's cgroup and its
+ * ancestors, any of which can be the one limiting a container.
+ */
+static void cgroup_limit(size_t *limit) {
+    char dir[MAXLINE];
+    size_t root_len = strlen(cgroup_root);
+    snprintf(dir, sizeof(dir), "%s", cgroup_dir);
+    while (strlen(dir) > root_len) {
+        size_t max;
+        if (read_bytes(dir, "memory.max", &max) && max < *limit) {
+            *limit = max;
+        }
+        *strrchr(dir, '/') = '\0';
+    }
+}
+/**
+ * @brief Sample the memory limit, usage and pressure. The whole machine
+ * stands in for the cgroup where it has no limit or no statistics.
+ *
+ * @return false if the memory of the machine cannot be read
+ */
+static bool mem_sample(mem_sample_t *s) {
+    char line[MAXLINE];
+    size_t total = 0;
+    size_t avail = 0;
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (fp == NULL) {
+        return false;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        unsigned long long kb;
+        if (sscanf(line, "MemTotal: %llu kB", &kb) == 1) {
+            total = (size_t)kb * 1024;
+        } else if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+            avail = (size_t)kb * 1024;
+        }
+    }
+    fclose(fp);
+    if (total == 0 || avail > total) {
+        return false;
+    }
+    s->limit = total;
+    s->used = total - avail;
+    s->pressure = 0;
+    if (cgroup_dir[0] != '\0') {
+        cgroup_limit(&s->limit);
+        read_bytes(cgroup_dir, "memory.current", &s->used);
+    }
+    // the cgroup's own pressure, or the machine's
+    if ((cgroup_dir[0] == '\0' ||
+         !read_first_line(cgroup_dir, "memory.pressure", line,
+                          sizeof(line))) &&
+        !read_first_line("/proc/pressure", "memory", line, sizeof(line))) {
+        return true; // no PSI, sized by spare memory alone
+    }
+    sscanf(line, "some avg10=%lf", &s->pressure);
+    return true;
+}
+/**
+ * @brief Compute the next cache budget from a sample.
+ */
+static size_t next_budget(size_t budget, const mem_sample_t *s) {
+    size_t reserve = s->limit / MEMWATCH_RESERVE_DIV;
+    size_t spare = s->limit > s->used ? s->limit - s->used : 0;
+    if (s->pressure >= MEMWATCH_PRESSURE_HIGH || spare < reserve) {
+        budget = budget - budget / MEMWATCH_SHRINK_DIV;
+    } else if (s->pressure <= MEMWATCH_PRESSURE_LOW && spare > 2 * reserve &&
+               cache_bytes() >= CACHE_LOW_WATER(budget)) {
+        // only a cache that fills its budget needs more
+        budget = budget + (spare - 2 * reserve) / MEMWATCH_GROW_DIV;
+    }
+    return budget < MAX_CACHE_SIZE ? MAX_CACHE_SIZE : budget;
+}
+/**
+ * @brief Watcher thread, adjusting the budget after each sample.
+ */
+static void *watcher(void *vargp) {
+    pthread_detach(pthread_self());
+    bool shrunk = false;
+    while (true) {
+        sleep(MEMWATCH_INTERVAL);
+#ifdef __GLIBC__
+        // the blocks evicted since the last sample are freed by now; give
+        // their memory back so that it stops counting against the limit
+        if (shrunk) {
+            malloc_trim(0);
+        }
+#endif
+        mem_sample_t s;
+        if (!mem_sample(&s)) {
+            continue;
+        }
+        size_t budget = cache_budget();
+        size_t next = next_budget(budget, &s);
+        shrunk = next < budget;
+        if (next != budget) {
+            cache_set_budget(next);
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief Start the thread sizing the cache budget.
+ */
+int memwatch_start() {
+    pthread_t tid;
+    find_cgroup();
+    return pthread_create(&tid, NULL, watcher, NULL) != 0 ? -1 : 0;
+}
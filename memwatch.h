@@ -0,0 +1,37 @@
+/**
+ * @file memwatch.h
+ * @author Xianwei Zou
+ * @brief Sizing of the cache budget by memory limit and pressure.
+ *
+ * A thread samples the memory limit and usage of the proxy's cgroup (v2
+ * memory.max and memory.current, or the whole machine's memory when there
+ * is no limit) and its memory pressure (PSI, the share of time tasks were
+ * stalled waiting for memory) every MEMWATCH_INTERVAL seconds. The cache
+ * budget grows into spare memory while pressure is low, and shrinks as
+ * soon as pressure rises or spare memory runs short, the evictor thread
+ * making room. Between the two thresholds the budget is left alone, so
+ * that it does not oscillate. It never goes below MAX_CACHE_SIZE.
+ */
+#ifndef MEMWATCH_H
+#define MEMWATCH_H
+// Seconds between two samples
+#define MEMWATCH_INTERVAL 1
+// Share of time in % stalled on memory over the last 10 s above which the
+// budget shrinks, and below which it may grow
+#define MEMWATCH_PRESSURE_HIGH 10.0
+#define MEMWATCH_PRESSURE_LOW 1.0
+// Spare memory is kept above one reserve, 1/MEMWATCH_RESERVE_DIV of the
+// limit: the budget shrinks below one reserve and grows above two
+#define MEMWATCH_RESERVE_DIV 10
+// The budget shrinks by 1/MEMWATCH_SHRINK_DIV per sample under pressure
+#define MEMWATCH_SHRINK_DIV 4
+// The budget grows by 1/MEMWATCH_GROW_DIV of the spare memory per sample
+#define MEMWATCH_GROW_DIV 4
+/**
+ * @brief Start the thread sizing the cache budget. The cache must be
+ * initialized.
+ *
+ * @return 0, or -1 if the thread cannot be created
+ */
+int memwatch_start();
+#endif /* MEMWATCH_H */
@@ -0,0 +1,147 @@
+/**
+ * @file metrics.c
+ * @author Xianwei Zou
+ * @brief Counters of the proxy, served in the Prometheus text format.
+ */
+#include "metrics.h"
+#include "cache.h"
+#include "csapp.h"
+#include "latency.h"
+#include "lockprof.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* Counters of the threads using a slot, on their own cache lines */
+typedef struct {
+    int64_t value[METRIC_CNT];
+} __attribute__((aligned(64))) metrics_slot_t;
+/* Description of a counter, samples of one family must be adjacent */
+typedef struct {
+    const char *family; // metric name
+    const char *labels; // labels of the sample, or ""
+    const char *type;   // counter or gauge
+    const char *help;   // description
+} metric_info_t;
+static const metric_info_t metric_info[METRIC_CNT] = {
+    [METRIC_HITS] = {"proxy_cache_hits_total", "", "counter",
+                     "Requests served from the cache."},
+    [METRIC_MISSES] = {"proxy_cache_misses_total", "", "counter",
+                       "Cacheable requests fetched from the server."},
+    [METRIC_EVICTIONS] = {"proxy_cache_evictions_total", "", "counter",
+                          "Objects evicted from the cache."},
+    [METRIC_EXPIRATIONS] = {"proxy_cache_expirations_total", "", "counter",
+                            "Objects removed from the cache as they expired."},
+    [METRIC_BYTES_IN] = {"proxy_upstream_bytes_total", "", "counter",
+                         "Bytes received from servers."},
+    [METRIC_BYTES_OUT] = {"proxy_client_bytes_total", "", "counter",
+                          "Bytes sent to clients."},
+    [METRIC_UPSTREAM_CONNECTS] = {"proxy_upstream_connects_total", "",
+                                  "counter", "Connections made to servers."},
+    [METRIC_CONNECTIONS] = {"proxy_active_connections", "", "gauge",
+                            "Client connections being handled."},
+    [METRIC_ERR_BAD_REQUEST] = {"proxy_errors_total", "type=\"bad_request\"",
+                                "counter", "Errors by type."},
+    [METRIC_ERR_METHOD] = {"proxy_errors_total", "type=\"method\"", "counter",
+                           "Errors by type."},
+    [METRIC_ERR_UPSTREAM_CONNECT] = {"proxy_errors_total",
+                                     "type=\"upstream_connect\"", "counter",
+                                     "Errors by type."},
+    [METRIC_ERR_UPSTREAM_READ] = {"proxy_errors_total",
+                                  "type=\"upstream_read\"", "counter",
+                                  "Errors by type."},
+    [METRIC_ERR_CLIENT_WRITE] = {"proxy_errors_total", "type=\"client_write\"",
+                                 "counter", "Errors by type."},
+    [METRIC_ERR_TIMEOUT] = {"proxy_errors_total", "type=\"timeout\"",
+                            "counter", "Errors by type."},
+};
+static metrics_slot_t slots[METRICS_SLOTS];
+static unsigned next_slot = 0;   // slot of the next new thread, wraps
+static __thread int my_slot = -1; // slot of the calling thread
+/**
+ * @brief Add to a counter of the calling thread.
+ */
+void metrics_add(metric_t metric, int64_t n) {
+    if (my_slot < 0) {
+        my_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) %
+                  METRICS_SLOTS;
+    }
+    __atomic_fetch_add(&slots[my_slot].value[metric], n, __ATOMIC_RELAXED);
+}
+/**
+ * @brief Sum a counter over all threads.
+ */
+int64_t metrics_get(metric_t metric) {
+    int64_t sum = 0;
+    for (int i = 0; i < METRICS_SLOTS; i++) {
+        sum += __atomic_load_n(&slots[i].value[metric], __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+/**
+ * @brief Append formatted text to buf, unless it does not fit.
+ */
+void metrics_printf(char *buf, size_t len, size_t *used, const char *fmt,
+                    ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *used, len - *used, fmt, ap);
+    va_end(ap);
+    if (n >= 0 && *used + n < len) {
+        *used += n;
+    } else {
+        buf[*used] = '\0';
+    }
+}
+/**
+ * @brief Append a sample, with its HELP and TYPE lines if it starts a family.
+ */
+static void render_sample(char *buf, size_t len, size_t *used,
+                          const char *family, const char *labels,
+                          const char *type, const char *help, bool first,
+                          int64_t value) {
+    if (first) {
+        metrics_printf(buf, len, used, "# HELP %s %s\n# TYPE %s %s\n", family,
+                       help, family, type);
+    }
+    metrics_printf(buf, len, used, "%s%s%s%s %" PRId64 "\n", family,
+                   *labels ? "{" : "", labels, *labels ? "}" : "", value);
+}
+/**
+ * @brief Send all counters to a client as an HTTP response.
+ */
+void metrics_write(int fd) {
+    char header[MAXLINE];
+    char *body = malloc(METRICS_BUF_SIZE);
+    if (body == NULL) {
+        return;
+    }
+    size_t len = 0;
+    for (int i = 0; i < METRIC_CNT; i++) {
+        const metric_info_t *info = &metric_info[i];
+        bool first = i == 0 || strcmp(metric_info[i - 1].family, info->family);
+        render_sample(body, METRICS_BUF_SIZE, &len, info->family, info->labels,
+                      info->type, info->help, first, metrics_get(i));
+    }
+    render_sample(body, METRICS_BUF_SIZE, &len, "proxy_cache_bytes", "",
+                  "gauge", "Bytes used by cached objects.", true,
+                  (int64_t)cache_bytes());
+    render_sample(body, METRICS_BUF_SIZE, &len, "proxy_cache_budget_bytes",
+                  "", "gauge", "Max bytes used by cached objects.", true,
+                  (int64_t)cache_budget());
+    len += latency_render(body + len, METRICS_BUF_SIZE - len);
+    len += lockprof_render(body + len, METRICS_BUF_SIZE - len);
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.0 200 OK\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %zu\r\n\r\n",
+                     len);
+    rio_out_t out;
+    rio_outinitb(&out, fd);
+    if (rio_writeb(&out, header, n) >= 0 && rio_writeb(&out, body, len) >= 0) {
+        rio_flushb(&out);
+    }
+    free(body);
+}
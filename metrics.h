@@ -0,0 +1,61 @@
+/**
+ * @file metrics.h
+ * @author Xianwei Zou
+ * @brief Counters of the proxy, served in the Prometheus text format.
+ *
+ * Counters are kept in per-thread slots and updated with relaxed atomic
+ * adds, so counting takes no lock and threads do not share cache lines.
+ * A request for METRICS_PATH sent to the proxy itself (rather than an
+ * absolute url) returns the sums over all slots.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+#include <stddef.h>
+#include <stdint.h>
+// Path of the metrics endpoint
+#define METRICS_PATH "/metrics"
+// Max size of the metrics response body
+#define METRICS_BUF_SIZE (64 * 1024)
+// Number of counter slots, threads beyond this share slots
+#define METRICS_SLOTS 64
+// Counters and gauges, see metric_info in metrics.c for descriptions
+typedef enum {
+    METRIC_HITS,
+    METRIC_MISSES,
+    METRIC_EVICTIONS,
+    METRIC_EXPIRATIONS,
+    METRIC_BYTES_IN,
+    METRIC_BYTES_OUT,
+    METRIC_UPSTREAM_CONNECTS,
+    METRIC_CONNECTIONS,
+    METRIC_ERR_BAD_REQUEST,
+    METRIC_ERR_METHOD,
+    METRIC_ERR_UPSTREAM_CONNECT,
+    METRIC_ERR_UPSTREAM_READ,
+    METRIC_ERR_CLIENT_WRITE,
+    METRIC_ERR_TIMEOUT,
+    METRIC_CNT
+} metric_t;
+/**
+ * @brief Add to a counter of the calling thread. Gauges take negative n.
+ */
+void metrics_add(metric_t metric, int64_t n);
+/**
+ * @brief Sum a counter over all threads.
+ */
+int64_t metrics_get(metric_t metric);
+/**
+ * @brief Append formatted text to a response being rendered, unless it
+ * does not fit.
+ *
+ * @param len size of buf
+ * @param[in,out] used bytes already used in buf
+ */
+void metrics_printf(char *buf, size_t len, size_t *used, const char *fmt,
+                    ...);
+/**
+ * @brief Send all counters, the latency histograms of latency.h and the
+ * mutex statistics of lockprof.h to a client as an HTTP response.
+ */
+void metrics_write(int fd);
+#endif /* METRICS_H */
@@ -0,0 +1,268 @@
+/**
+ * @file prefetch.c
+ * @author Xianwei Zou
+ * @brief Background prefetching of the resources referenced by HTML pages.
+ */
+#include "prefetch.h"
+#include "cache.h"
+#include "cache_key.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+/* Urls waiting to be fetched, as a ring buffer */
+static char *queue[PREFETCH_QUEUE_LEN];
+static int queue_head = 0;
+static int queue_cnt = 0;
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;  // not empty
+static pthread_cond_t queueSpace = PTHREAD_COND_INITIALIZER; // not full
+/* Configuration, set once at startup */
+static bool enabled = false;
+static int max_per_page = PREFETCH_PAGE_MAX;
+static prefetch_fetch_t fetch_url;
+/**
+ * @brief Take the next url off the queue, waiting for one if it is empty.
+ */
+static char *dequeue() {
+    pthread_mutex_lock(&queueLock);
+    while (queue_cnt == 0) {
+        pthread_cond_wait(&queueCond, &queueLock);
+    }
+    char *url = queue[queue_head];
+    queue_head = (queue_head + 1) % PREFETCH_QUEUE_LEN;
+    queue_cnt = queue_cnt - 1;
+    pthread_cond_signal(&queueSpace);
+    pthread_mutex_unlock(&queueLock);
+    return url;
+}
+/**
+ * @brief Worker thread, fetching queued urls that are not cached yet.
+ */
+static void *worker(void *vargp) {
+    pthread_detach(pthread_self());
+    while (true) {
+        char *url = dequeue();
+        if (!cache_contains(url, cache_key_hash(url, strlen(url)))) {
+            fetch_url(url);
+        }
+        free(url);
+    }
+    return NULL;
+}
+/**
+ * @brief Start the worker threads.
+ */
+int prefetch_init(int workers, int page_max, prefetch_fetch_t fetch) {
+    fetch_url = fetch;
+    max_per_page = page_max;
+    for (int i = 0; i < workers; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, NULL) != 0) {
+            return -1;
+        }
+    }
+    enabled = workers > 0 && page_max > 0;
+    return 0;
+}
+/**
+ * @brief Queue a canonical url to be fetched into the cache.
+ */
+bool prefetch_enqueue(const char *url, bool wait) {
+    pthread_mutex_lock(&queueLock);
+    while (wait && queue_cnt == PREFETCH_QUEUE_LEN) {
+        pthread_cond_wait(&queueSpace, &queueLock);
+    }
+    bool queued = queue_cnt < PREFETCH_QUEUE_LEN;
+    for (int i = 0; queued && i < queue_cnt; i++) {
+        if (!strcmp(queue[(queue_head + i) % PREFETCH_QUEUE_LEN], url)) {
+            queued = false;
+        }
+    }
+    char *copy = queued ? strdup(url) : NULL;
+    if (copy != NULL) {
+        queue[(queue_head + queue_cnt) % PREFETCH_QUEUE_LEN] = copy;
+        queue_cnt = queue_cnt + 1;
+        pthread_cond_signal(&queueCond);
+    }
+    pthread_mutex_unlock(&queueLock);
+    return copy != NULL;
+}
+/**
+ * @brief Find the length of the origin ("http://host:port") of a key.
+ */
+static size_t origin_length(const char *url) {
+    const char *authority = strstr(url, "://");
+    if (authority == NULL) {
+        return 0;
+    }
+    authority += 3;
+    return authority - url + strcspn(authority, "/?#");
+}
+/**
+ * @brief Resolve a link found in a page against the url of the page.
+ *
+ * @param page canonical key of the page
+ * @param link the attribute value, not NUL-terminated
+ * @param len length of the link
+ * @param[out] url buffer receiving the absolute url
+ * @param urllen size of the url buffer
+ * @return false if the link is not an http url that can be fetched
+ */
+static bool resolve_link(const char *page, const char *link, size_t len,
+                         char *url, size_t urllen) {
+    size_t origin_len = origin_length(page);
+    const char *base = page; // the link is appended to a prefix of base
+    size_t base_len = origin_len;
+    const char *sep = "";
+    if (len == 0 || link[0] == '#') {
+        return false;
+    } else if (len >= 2 && link[0] == '/' && link[1] == '/') {
+        // network-path reference, keeps the scheme of the page
+        base = "http:";
+        base_len = 5;
+    } else if (link[0] != '/') {
+        size_t scheme = 0;
+        while (scheme < len && (isalnum((unsigned char)link[scheme]) ||
+                                strchr("+-.", link[scheme]) != NULL)) {
+            scheme++;
+        }
+        if (scheme < len && link[scheme] == ':') {
+            if (scheme != 4 || strncasecmp(link, "http", 4)) {
+                return false; // https, mailto, data, javascript...
+            }
+            base_len = 0;
+        } else {
+            // relative path, resolved against the directory of the page
+            base_len = origin_len + strcspn(page + origin_len, "?#");
+            while (base_len > origin_len && page[base_len - 1] != '/') {
+                base_len--;
+            }
+            if (base_len == origin_len) {
+                sep = "/";
+            }
+        }
+    }
+    int n = snprintf(url, urllen, "%.*s%s%.*s", (int)base_len, base, sep,
+                     (int)len, link);
+    return n >= 0 && (size_t)n < urllen;
+}
+/**
+ * @brief Find the value of an attribute in a tag.
+ *
+ * @param tag the text of the tag after its name, up to the closing '>'
+ * @param end end of the tag
+ * @param[out] len length of the value
+ * @return the value, or NULL if the tag has no such attribute
+ */
+static const char *tag_attribute(const char *tag, const char *end,
+                                 const char *name, size_t *len) {
+    size_t name_len = strlen(name);
+    const char *p = tag;
+    while (p < end) {
+        while (p < end && (isspace((unsigned char)*p) || *p == '/')) {
+            p++;
+        }
+        const char *attr = p;
+        while (p < end && !isspace((unsigned char)*p) && *p != '=' &&
+               *p != '/') {
+            p++;
+        }
+        size_t attr_len = p - attr;
+        while (p < end && isspace((unsigned char)*p)) {
+            p++;
+        }
+        const char *value = p;
+        size_t value_len = 0;
+        if (p < end && *p == '=') {
+            p++;
+            while (p < end && isspace((unsigned char)*p)) {
+                p++;
+            }
+            if (p < end && (*p == '"' || *p == '\'')) {
+                char quote = *p++;
+                value = p;
+                while (p < end && *p != quote) {
+                    p++;
+                }
+                value_len = p - value;
+                p = p < end ? p + 1 : p;
+            } else {
+                value = p;
+                while (p < end && !isspace((unsigned char)*p)) {
+                    p++;
+                }
+                value_len = p - value;
+            }
+        }
+        if (attr_len == name_len && !strncasecmp(attr, name, name_len)) {
+            // surrounding whitespace is not part of a url
+            while (value_len > 0 && isspace((unsigned char)*value)) {
+                value++;
+                value_len--;
+            }
+            while (value_len > 0 &&
+                   isspace((unsigned char)value[value_len - 1])) {
+                value_len--;
+            }
+            *len = value_len;
+            return value;
+        }
+        if (attr_len == 0 && p == value) {
+            p++; // stray character
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief Queue the same-origin resources referenced by an HTML page.
+ */
+void prefetch_page(const char *url, const char *resp, size_t size) {
+    if (!enabled || response_status(resp, size) != 200) {
+        return;
+    }
+    size_t hdr_len = header_length(resp, 0, size);
+    size_t type_len, coding_len;
+    const char *type = header_value(resp, hdr_len, "Content-Type", &type_len);
+    if (hdr_len == 0 || type == NULL || type_len < 9 ||
+        strncasecmp(type, "text/html", 9) ||
+        header_value(resp, hdr_len, "Content-Encoding", &coding_len) != NULL) {
+        return;
+    }
+    size_t origin_len = origin_length(url);
+    const char *p = resp + hdr_len;
+    const char *end = resp + size;
+    int queued = 0;
+    while (queued < max_per_page &&
+           (p = memchr(p, '<', end - p)) != NULL) {
+        const char *name = ++p;
+        while (p < end && isalnum((unsigned char)*p)) {
+            p++;
+        }
+        size_t name_len = p - name;
+        const char *tag_end = memchr(p, '>', end - p);
+        if (tag_end == NULL) {
+            break;
+        }
+        // stylesheets and icons are link hrefs, the rest are srcs
+        bool is_link = name_len == 4 && !strncasecmp(name, "link", 4);
+        size_t len;
+        const char *link =
+            tag_attribute(p, tag_end, is_link ? "href" : "src", &len);
+        char abs[MAXLINE], key[MAXLINE];
+        ssize_t keylen;
+        if (name_len > 0 && link != NULL &&
+            resolve_link(url, link, len, abs, sizeof(abs)) &&
+            (keylen = cache_key_build(abs, key, sizeof(key))) >= 0 &&
+            origin_length(key) == origin_len &&
+            !strncmp(key, url, origin_len) && strcmp(key, url) &&
+            !cache_contains(key, cache_key_hash(key, keylen)) &&
+            prefetch_enqueue(key, false)) {
+            queued++;
+        }
+        p = tag_end + 1;
+    }
+}
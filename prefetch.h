@@ -0,0 +1,51 @@
+/**
+ * @file prefetch.h
+ * @author Xianwei Zou
+ * @brief Background prefetching of the resources referenced by HTML pages.
+ *
+ * When the proxy relays an HTML page that was not in the cache, the page is
+ * scanned for the resources the browser is about to ask for (src attributes,
+ * and href attributes of link tags) on the same origin. Those are queued and
+ * fetched into the cache by a fixed pool of worker threads, so that the
+ * requests that follow the page are cache hits.
+ */
+#ifndef PREFETCH_H
+#define PREFETCH_H
+#include <stdbool.h>
+#include <stddef.h>
+// Max number of urls waiting to be fetched
+#define PREFETCH_QUEUE_LEN 64
+// Default max number of resources prefetched for one page
+#define PREFETCH_PAGE_MAX 16
+// Default number of worker threads when only warm-up uses them
+#define PREFETCH_WORKERS 4
+// Fetches a canonical url into the cache, called by the worker threads
+typedef void (*prefetch_fetch_t)(const char *url);
+/**
+ * @brief Start the worker threads. Nothing is fetched until this is called.
+ *
+ * @param workers number of worker threads, i.e. max concurrent fetches
+ * @param page_max max number of resources queued for one page, or 0 to
+ * not scan pages and only fetch urls queued by prefetch_enqueue()
+ * @param fetch function used to fetch a url into the cache
+ * @return 0 on success, -1 if the threads could not be started
+ */
+int prefetch_init(int workers, int page_max, prefetch_fetch_t fetch);
+/**
+ * @brief Queue the same-origin resources referenced by an HTML page.
+ * Does nothing if prefetching is disabled or the response is not a
+ * successful text/html response.
+ *
+ * @param url canonical key of the page
+ * @param resp the response, with its header block
+ * @param size length of the response
+ */
+void prefetch_page(const char *url, const char *resp, size_t size);
+/**
+ * @brief Queue a canonical url to be fetched into the cache.
+ *
+ * @param wait wait for room if the queue is full, rather than dropping
+ * @return false if the url was dropped or is already queued
+ */
+bool prefetch_enqueue(const char *url, bool wait);
+#endif /* PREFETCH_H */
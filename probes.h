@@ -0,0 +1,49 @@
+/**
+ * @file probes.h
+ * @author Xianwei Zou
+ * @brief USDT static tracepoints of the proxy.
+ *
+ * With <sys/sdt.h> (systemtap-sdt-dev), which the Makefile detects and
+ * signals with HAVE_SYS_SDT_H, each probe compiles to a single NOP plus a
+ * note in the ELF file, so bpftrace or perf can attach to a running proxy:
+ *
+ *     bpftrace -e 'usdt:./proxy:cache_miss { printf("%s\n", str(arg0)); }'
+ *
+ * Without it, the probes compile to nothing. Arguments must be values that
+ * are already computed, so that probes cost nothing when not traced.
+ */
+#ifndef PROBES_H
+#define PROBES_H
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PROXY_PROBE1(name, a) DTRACE_PROBE1(proxy, name, a)
+#define PROXY_PROBE2(name, a, b) DTRACE_PROBE2(proxy, name, a, b)
+#define PROXY_PROBE3(name, a, b, c) DTRACE_PROBE3(proxy, name, a, b, c)
+#else
+#define PROXY_PROBE1(name, a)
+#define PROXY_PROBE2(name, a, b)
+#define PROXY_PROBE3(name, a, b, c)
+#endif
+// A request line was read from client fd
+#define PROBE_REQUEST_START(fd, uri) PROXY_PROBE2(request_start, fd, uri)
+// The request of client fd is done, hit is 1 if served from the cache
+#define PROBE_REQUEST_END(fd, uri, hit)                                        \
+    PROXY_PROBE3(request_end, fd, uri, hit)
+// A cached response of size bytes is being sent for url
+#define PROBE_CACHE_HIT(url, size) PROXY_PROBE2(cache_hit, url, size)
+// url is not in the cache
+#define PROBE_CACHE_MISS(url) PROXY_PROBE1(cache_miss, url)
+// A response of size bytes was cached for url
+#define PROBE_CACHE_INSERT(url, size) PROXY_PROBE2(cache_insert, url, size)
+// The block of url, of size bytes, was evicted
+#define PROBE_CACHE_EVICT(url, size) PROXY_PROBE2(cache_evict, url, size)
+// Connecting to a server
+#define PROBE_UPSTREAM_CONNECT_START(host, port)                               \
+    PROXY_PROBE2(upstream_connect_start, host, port)
+// Connected to a server as fd, or failed if fd is negative
+#define PROBE_UPSTREAM_CONNECT_END(host, port, fd)                             \
+    PROXY_PROBE3(upstream_connect_end, host, port, fd)
+// n bytes of a response were relayed from server fd to client fd
+#define PROBE_RELAY(serverfd, clientfd, n)                                     \
+    PROXY_PROBE3(relay, serverfd, clientfd, n)
+#endif /* PROBES_H */
@@ -9,24 +9,41 @@
  * Reference: CSAPP Chapter 10-12
  */
 /* Some useful includes to help you get started */
+#include "arena.h"
+#include "bufpool.h"
 #include "cache.h"
+#include "cache_key.h"
 #include "csapp.h"
+#include "gzip.h"
+#include "header_id.h"
+#include "headers.h"
 #include "http_parser.h"
+#include "latency.h"
+#include "lockprof.h"
+#include "memwatch.h"
+#include "metrics.h"
+#include "prefetch.h"
+#include "probes.h"
+#include "warm.h"
+#include "wheel.h"
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <getopt.h>
 #include <inttypes.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 /*
  * Debug macros, which can be enabled by adding -DDEBUG in the Makefile
@@ -48,19 +65,47 @@ static const char *header_user_agent = "Mozilla/5.0"
                                        " Gecko/20191101 Firefox/63.0.1";
 static const char *CONNECT_HEADER = "Connection: close\r\n";
 static const char *PROXY_HEADER = "Proxy-Connection: close\r\n";
-static const char *HOST_HEADER = "Host: %s:%s\r\n";
 static const char *REQUESTLINE_HEADER = "GET %s HTTP/1.0\r\n";
 static const char *END_OF_LINE = "\r\n";
 #define HOSTLEN 256
 #define SERVLEN 8
+// Max bytes relayed per read, larger than RIO_BUFSIZE to bypass its copy;
+// each read relays what is available, without waiting for a full chunk
+#define RELAY_CHUNK (64 * 1024)
+// Stack size of connection threads in low-memory mode, instead of the
+// default (usually 8 MB), which limits how many connections fit in memory
+#define LOWMEM_STACK_SIZE (128 * 1024)
+// Max idle relay buffers kept in low-memory mode
+#define LOWMEM_IDLE_BUFS 4
+// Max iovec entries of a forwarded request: 4 per header, plus the rest
+#define REQUEST_IOV_CNT (4 * HEADERS_MAX + 16)
 /* Typedef for convenience */
 typedef struct sockaddr SA;
+/* Timeout of the blocking I/O of a connection, or of a prefetch */
+typedef struct {
+    wheel_timer_t timer; // pending while armed
+    int client_fd;       // fds shut down when it expires, -1 for none
+    int server_fd;
+    bool expired; // the fds have been shut down
+} conn_timeout_t;
+static prof_mutex_t timeoutLock;
+static wheel_t timeout_wheel; // armed timeouts, in seconds
+// Seconds a client may take to send its request or take a cached response,
+// and a server to send more of its response; 0, the default, for never
+static int idle_timeout = 0;
+static int read_timeout = 0;
 /* Function Declaration */
-void doit(int fd);
+void doit(int fd, arena_t *arena, conn_timeout_t *timeout);
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg,
                  char *longmsg);
-void forward_header(char *http_header, char *host, char *path, char *port,
-                    rio_t client_rio);
+int forward_header(struct iovec *iov, const char *host, const char *path,
+                   const char *port, const headers_t *headers,
+                   bool *accept_gzip);
+ssize_t relay_response(rio_t *server_rio, int fd, cache_fill_t *fill,
+                       conn_timeout_t *timeout);
+void fetch_url(const char *url);
+void usage(char *prog);
+void parse_negative_ttl(char *prog, char *arg);
 /**
  * @brief Display the error message for the client.
  * Reference from CSAPP Figure 11.31
@@ -78,105 +123,446 @@ void clienterror(int fd, char *cause, char *errnum, char *shortmsg,
     sprintf(body, "%s%s: %s\r\n", body, errnum, shortmsg);
     sprintf(body, "%s<p>%s: %s\r\n", body, longmsg, cause);
     sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
-    /* Print the HTTP response */
+    /* Print the HTTP response, sent at once by rio_flushb() */
+    rio_out_t out;
+    rio_outinitb(&out, fd);
     sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-    rio_writen(fd, buf, strlen(buf));
+    rio_writeb(&out, buf, strlen(buf));
     sprintf(buf, "Content-type: text/html\r\n");
-    rio_writen(fd, buf, strlen(buf));
+    rio_writeb(&out, buf, strlen(buf));
     sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body));
-    rio_writen(fd, buf, strlen(buf));
-    rio_writen(fd, body, strlen(body));
+    rio_writeb(&out, buf, strlen(buf));
+    rio_writeb(&out, body, strlen(body));
+    rio_flushb(&out);
 }
 /**
- * @brief Forward header from the client to the server
+ * @brief Append a string to an iovec list.
  *
+ * @return the new number of entries
  */
-void forward_header(char *http_header, char *host, char *path, char *port,
-                    rio_t client_rio) {
-    char request_header[MAXLINE], host_header[MAXLINE], user_header[MAXLINE],
-        other_header[MAXLINE], buf[MAXLINE];
-    sprintf(request_header, REQUESTLINE_HEADER, path);
-    while (rio_readlineb(&client_rio, buf, MAXLINE) > 0) {
-        int not_end = strcmp(buf, END_OF_LINE);
-        if (not_end) {
-            if (strstr(buf, "Host")) {
-            } else if (strstr(buf, "Connection")) {
-            } else if (strstr(buf, "User-Agent")) {
-            } else if (strstr(buf, "Proxy-Connection")) {
-            } else {
-                strcat(other_header, buf);
+static int iov_push(struct iovec *iov, int iovcnt, const char *base,
+                    size_t len) {
+    iov[iovcnt].iov_base = (char *)base;
+    iov[iovcnt].iov_len = len;
+    return iovcnt + 1;
+}
+/**
+ * @brief Build the request forwarded to the server as an iovec list, which
+ * refers to the client's headers in place.
+ * Host, Connection, Proxy-Connection and User-Agent are replaced by the
+ * proxy's own, and the other hop-by-hop headers are dropped.
+ * Accept-Encoding is not forwarded, so that the cache always gets plain
+ * bodies; whether the client accepts gzip is returned in accept_gzip.
+ *
+ * @param iov array of REQUEST_IOV_CNT entries
+ * @return number of entries used
+ */
+int forward_header(struct iovec *iov, const char *host, const char *path,
+                   const char *port, const headers_t *headers,
+                   bool *accept_gzip) {
+    int n = 0;
+    n = iov_push(iov, n, "GET ", 4);
+    n = iov_push(iov, n, path, strlen(path));
+    n = iov_push(iov, n, " HTTP/1.0\r\nHost: ", 17);
+    n = iov_push(iov, n, host, strlen(host));
+    n = iov_push(iov, n, ":", 1);
+    n = iov_push(iov, n, port, strlen(port));
+    n = iov_push(iov, n, "\r\nUser-Agent: ", 14);
+    n = iov_push(iov, n, header_user_agent, strlen(header_user_agent));
+    n = iov_push(iov, n, END_OF_LINE, 2);
+    n = iov_push(iov, n, CONNECT_HEADER, strlen(CONNECT_HEADER));
+    n = iov_push(iov, n, PROXY_HEADER, strlen(PROXY_HEADER));
+    *accept_gzip = false;
+    for (int i = 0; i < headers->cnt; i++) {
+        const header_slice_t *hdr = &headers->hdrs[i];
+        if (hdr->id == HDR_ACCEPT_ENCODING) {
+            *accept_gzip = gzip_accepted(hdr->value);
+        } else if (!(header_id_flags[hdr->id] &
+                     (HDR_HOP_BY_HOP | HDR_REWRITTEN))) {
+            n = iov_push(iov, n, hdr->name, hdr->name_len);
+            n = iov_push(iov, n, ": ", 2);
+            n = iov_push(iov, n, hdr->value, hdr->value_len);
+            n = iov_push(iov, n, END_OF_LINE, 2);
+        }
+    }
+    return iov_push(iov, n, END_OF_LINE, 2);
+}
+/**
+ * @brief Current time in seconds, the ticks of timeout_wheel.
+ */
+static uint64_t timeout_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+/**
+ * @brief Tick at which a timeout of some seconds from now expires, rounded
+ * up so that it never fires before the full seconds have passed.
+ */
+static uint64_t timeout_expiry(int seconds) {
+    return timeout_now() + seconds + 1;
+}
+/**
+ * @brief Arm or re-arm a timeout. Unless touched, the fds are shut down
+ * when it expires, which fails the blocking reads and writes on them.
+ *
+ * @param seconds seconds from now, or 0 to never expire
+ */
+static void timeout_arm(conn_timeout_t *timeout, int client_fd,
+                        int server_fd, int seconds) {
+    prof_mutex_lock(&timeoutLock);
+    wheel_del(&timeout->timer);
+    timeout->client_fd = client_fd;
+    timeout->server_fd = server_fd;
+    timeout->expired = false;
+    if (seconds > 0) {
+        wheel_add(&timeout_wheel, &timeout->timer, timeout_expiry(seconds));
+    }
+    prof_mutex_unlock(&timeoutLock);
+}
+/**
+ * @brief Push back an armed timeout after some progress. The lock is only
+ * taken when the expiry moves, at most once per second.
+ */
+static void timeout_touch(conn_timeout_t *timeout, int seconds) {
+    uint64_t expires = timeout_expiry(seconds);
+    if (seconds <= 0 || timeout->timer.expires == expires) {
+        return;
+    }
+    prof_mutex_lock(&timeoutLock);
+    if (wheel_pending(&timeout->timer)) {
+        wheel_add(&timeout_wheel, &timeout->timer, expires);
+    }
+    prof_mutex_unlock(&timeoutLock);
+}
+/**
+ * @brief Disarm a timeout, before its fds are closed.
+ *
+ * @return true if it had expired
+ */
+static bool timeout_disarm(conn_timeout_t *timeout) {
+    prof_mutex_lock(&timeoutLock);
+    wheel_del(&timeout->timer);
+    bool expired = timeout->expired;
+    timeout->client_fd = -1;
+    timeout->server_fd = -1;
+    prof_mutex_unlock(&timeoutLock);
+    return expired;
+}
+/**
+ * @brief Shut down the fds of the timeouts that expire, once a second.
+ * The threads blocked on them see an error or EOF and close them.
+ */
+static void *timeout_ticker(void *vargp) {
+    pthread_detach(pthread_self());
+    while (1) {
+        sleep(1);
+        prof_mutex_lock(&timeoutLock);
+        wheel_timer_t *timer = wheel_advance(&timeout_wheel, timeout_now());
+        while (timer != NULL) {
+            conn_timeout_t *timeout = wheel_entry(timer, conn_timeout_t, timer);
+            timer = timer->next;
+            if (timeout->client_fd >= 0) {
+                shutdown(timeout->client_fd, SHUT_RDWR);
             }
-        } else {
-            sprintf(host_header, HOST_HEADER, host, port);
-            sprintf(user_header, "User-Agent: %s\r\n", header_user_agent);
-            sprintf(http_header, "%s%s%s%s%s%s%s", request_header, host_header,
-                    user_header, CONNECT_HEADER, PROXY_HEADER, other_header,
-                    END_OF_LINE);
-            return;
+            if (timeout->server_fd >= 0) {
+                shutdown(timeout->server_fd, SHUT_RDWR);
+            }
+            timeout->expired = true;
+            metrics_add(METRIC_ERR_TIMEOUT, 1);
         }
+        prof_mutex_unlock(&timeoutLock);
     }
+    return NULL;
+}
+/**
+ * @brief Relay a response from the server to the client, reading it
+ * straight into the cache storage of fill as long as it fits in a cache
+ * object. Once it does not, the storage is reused from its start as the
+ * relay buffer. A negative fd only reads the response into fill.
+ * The timeout is pushed back as data arrives, and disarmed on return.
+ *
+ * @return total size of the response, or -1 if reading it failed or
+ * timed out
+ */
+ssize_t relay_response(rio_t *server_rio, int fd, cache_fill_t *fill,
+                       conn_timeout_t *timeout) {
+    ssize_t n;
+    uint64_t start = latency_now(); // the request has just been sent
+    while (1) {
+        char *dst = fill->data;
+        size_t chunk = RELAY_CHUNK;
+        if (fill->len < MAX_OBJECT_SIZE) {
+            dst = fill->data + fill->len;
+            if (chunk > MAX_OBJECT_SIZE - fill->len) {
+                chunk = MAX_OBJECT_SIZE - fill->len;
+            }
+        }
+        // bytes are relayed as soon as they arrive, so the latency of
+        // the first read is the time to first byte
+        if ((n = rio_readsomeb(server_rio, dst, chunk)) <= 0) {
+            break;
+        }
+        timeout_touch(timeout, read_timeout); // on every read that progresses
+        if (fill->len == 0) {
+            latency_record(PHASE_FIRST_BYTE, start);
+        }
+        PROBE_RELAY(server_rio->rio_fd, fd, n);
+        metrics_add(METRIC_BYTES_IN, n);
+        if (fd >= 0 && rio_writen(fd, dst, n) < 0) {
+            // keep reading, the response can still be cached
+            metrics_add(METRIC_ERR_CLIENT_WRITE, 1);
+            fd = -1;
+        } else if (fd >= 0) {
+            metrics_add(METRIC_BYTES_OUT, n);
+        }
+        cache_fill_append(fill, n);
+    }
+    // a timed out response ends early, with an EOF, and is not cached
+    if (timeout_disarm(timeout)) {
+        n = -1;
+    } else if (n < 0) {
+        metrics_add(METRIC_ERR_UPSTREAM_READ, 1);
+    }
+    latency_record(PHASE_TRANSFER, start);
+    return n < 0 ? -1 : (ssize_t)fill->len;
+}
+/**
+ * @brief Copy the next whitespace-separated field of a request line into
+ * the arena at its exact size, and move past it.
+ *
+ * @return the field, empty if there is none, or NULL if out of memory
+ */
+static char *request_field(arena_t *arena, const char **pos) {
+    static const char *SPACES = " \t\r\n\v\f";
+    const char *start = *pos + strspn(*pos, SPACES);
+    size_t len = strcspn(start, SPACES);
+    *pos = start + len;
+    return arena_strndup(arena, start, len);
 }
 /**
  * @brief Core part of the proxy
  * Reference CSAPP Figure 11.0
+ * Request-scoped memory (read buffers, request line, parser, headers,
+ * forwarded request) comes from the connection's arena, which the caller
+ * resets afterwards, so no return path has anything to free.
  *
  */
-void doit(int fd) {
-    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE],
-        cachebuf[MAX_OBJECT_SIZE];
-    rio_t client_rio, server_rio;
+void doit(int fd, arena_t *arena, conn_timeout_t *timeout) {
     int clientfd;
     char *server_hostname;
     char *server_path;
     char *server_port;
-    char http_header[MAXLINE];
     /* Read request line and headers */
-    rio_readinitb(&client_rio, fd);
-    rio_readlineb(&client_rio, buf, MAXLINE);
-    if (sscanf(buf, "%s %s %s", method, uri, version) < 3) {
+    uint64_t start = latency_now();
+    rio_t *client_rio = arena_alloc(arena, sizeof(rio_t));
+    if (client_rio == NULL) {
+        return;
+    }
+    rio_readinitb(client_rio, fd);
+    // copied at its exact size, so that a waiting connection only touches
+    // the memory of what it has received
+    char *line;
+    ssize_t n = rio_peeklineb(client_rio, &line);
+    if (n <= 0) {
+        line = ""; // EOF or error, answered as a bad request
+        n = 0;
+    } else if (n >= MAXLINE) {
+        n = MAXLINE - 1;
+    }
+    char *buf = arena_strndup(arena, line, n);
+    if (buf == NULL) {
+        return;
+    }
+    rio_consumeb(client_rio, n);
+    latency_record(PHASE_REQUEST_LINE, start);
+    const char *pos = buf;
+    char *method = request_field(arena, &pos);
+    char *uri = request_field(arena, &pos);
+    char *version = request_field(arena, &pos);
+    if (version == NULL || uri == NULL || method == NULL) {
+        return;
+    }
+    if (version[0] == '\0') {
+        metrics_add(METRIC_ERR_BAD_REQUEST, 1);
         clienterror(fd, method, "400", "Bad Request", "Error parsing request");
         return;
     };
+    PROBE_REQUEST_START(fd, uri);
     if (strcasecmp(method, "GET")) {
+        metrics_add(METRIC_ERR_METHOD, 1);
         clienterror(fd, method, "501", "Not implemented",
                     "Proxy does not implement this method");
+        PROBE_REQUEST_END(fd, uri, 0);
+        return;
+    }
+    // request for the proxy itself rather than for a server
+    if (!strcmp(uri, METRICS_PATH)) {
+        metrics_write(fd);
+        PROBE_REQUEST_END(fd, uri, 0);
         return;
     }
-    // if the the content of uri is already in the cache
-    // send the body directly to clients, otherwise, cache
-    if (cache_check(fd, uri)) {
+    // the whole header block is waited for before anything else is
+    // allocated, so that a slow client holds as little memory as possible
+    bool accept_gzip;
+    start = latency_now();
+    headers_t *headers = arena_alloc(arena, sizeof(headers_t));
+    if (headers == NULL || headers_read(client_rio, headers, arena) < 0) {
+        metrics_add(METRIC_ERR_BAD_REQUEST, 1);
+        clienterror(fd, method, "400", "Bad Request", "Error parsing headers");
+        PROBE_REQUEST_END(fd, uri, 0);
         return;
     }
+    latency_record(PHASE_HEADERS, start);
     /* Parse request from URI */
-    parser_t *parser;
-    parser = parser_new();
-    parser_parse_line(parser, buf);
+    parser_t *parser = parser_new_in(arena);
+    struct iovec *request =
+        arena_alloc(arena, REQUEST_IOV_CNT * sizeof(struct iovec));
+    // canonical cache key, built and hashed once per request
+    size_t keysize = strlen(uri) + 2;
+    char *key = arena_alloc(arena, keysize);
+    if (key == NULL || request == NULL || parser == NULL) {
+        clienterror(fd, method, "500", "Internal Server Error",
+                    "Out of memory");
+        PROBE_REQUEST_END(fd, uri, 0);
+        return;
+    }
+    ssize_t keylen = cache_key_build(uri, key, keysize);
+    bool cacheable = keylen >= 0;
+    uint64_t hash = cacheable ? cache_key_hash(key, keylen) : 0;
+    if (parser_parse_line(parser, buf) != REQUEST) {
+        metrics_add(METRIC_ERR_BAD_REQUEST, 1);
+        clienterror(fd, method, "400", "Bad Request", "Error parsing request");
+        PROBE_REQUEST_END(fd, uri, 0);
+        return;
+    }
     parser_retrieve(parser, HOST, (const char **)&server_hostname);
     parser_retrieve(parser, PATH, (const char **)&server_path);
     parser_retrieve(parser, PORT, (const char **)&server_port);
+    int iovcnt = forward_header(request, server_hostname, server_path,
+                                server_port, headers, &accept_gzip);
+    // one lookup either finds the content of uri in the cache, which is
+    // sent directly to the client, or reserves the key for this request
+    cache_block_t *block;
+    cache_fill_t fill; // cache storage, into which the response is relayed
+    cache_result_t res = CACHE_FILLING;
+    if (cacheable) {
+        res = cache_acquire(key, hash, &block, &fill);
+    }
+    if (res == CACHE_HIT) {
+        timeout_arm(timeout, fd, -1, idle_timeout); // for the whole send
+        cache_send(fd, block, accept_gzip);
+        metrics_add(METRIC_HITS, 1);
+        PROBE_REQUEST_END(fd, uri, 1);
+        return;
+    }
+    if (cacheable) {
+        metrics_add(METRIC_MISSES, 1);
+        PROBE_CACHE_MISS(key);
+    }
+    // not cached by this request, relayed through unreserved storage
+    if (res == CACHE_FILLING && !cache_fill_reserve(&fill)) {
+        cache_fill_abort(&fill);
+        PROBE_REQUEST_END(fd, uri, 0);
+        return;
+    }
+    start = latency_now();
+    PROBE_UPSTREAM_CONNECT_START(server_hostname, server_port);
     clientfd = open_clientfd(server_hostname, server_port);
+    PROBE_UPSTREAM_CONNECT_END(server_hostname, server_port, clientfd);
+    latency_record(PHASE_CONNECT, start);
     if (clientfd < 0) {
+        metrics_add(METRIC_ERR_UPSTREAM_CONNECT, 1);
+        cache_fill_abort(&fill);
+        PROBE_REQUEST_END(fd, uri, 0);
         return;
     }
-    rio_readinitb(&server_rio, clientfd);
-    forward_header(http_header, server_hostname, server_path, server_port,
-                   client_rio);
-    rio_writen(clientfd, http_header, strlen(http_header));
-    size_t n;
-    size_t totalsize_cache = 0;
-    while ((n = rio_readnb(&server_rio, buf, MAXLINE)) != 0) {
-        rio_writen(fd, buf, n);
-        if (totalsize_cache + n <= MAX_OBJECT_SIZE) {
-            memcpy(cachebuf + totalsize_cache, buf, n);
-        }
-        totalsize_cache += n;
+    metrics_add(METRIC_UPSTREAM_CONNECTS, 1);
+    rio_t *server_rio = arena_alloc(arena, sizeof(rio_t));
+    if (server_rio == NULL) {
+        cache_fill_abort(&fill);
+        close(clientfd);
+        PROBE_REQUEST_END(fd, uri, 0);
+        return;
     }
+    // both ends are shut down if the server stops sending
+    timeout_arm(timeout, fd, clientfd, read_timeout);
+    rio_readinitb(server_rio, clientfd);
+    rio_writevn(clientfd, request, iovcnt);
+    ssize_t size = relay_response(server_rio, fd, &fill, timeout);
+    close(clientfd);
     /* cache */
-    if (totalsize_cache <= MAX_OBJECT_SIZE) {
-        cache_insert(uri, cachebuf, totalsize_cache);
+    if (res == CACHE_MISS && size >= 0 && size <= MAX_OBJECT_SIZE) {
+        // the resources of the page are likely to be requested next
+        prefetch_page(key, fill.data, size);
+        start = latency_now();
+        cache_fill_commit(&fill);
+        latency_record(PHASE_CACHE_INSERT, start);
+    } else {
+        cache_fill_abort(&fill);
     }
-    close(clientfd);
-    parser_free(parser);
+    PROBE_REQUEST_END(fd, uri, 0);
+}
+/**
+ * @brief Fetch a canonical url from its server into the cache, with no
+ * client. Used by the prefetch worker threads.
+ *
+ */
+void fetch_url(const char *url) {
+    char buf[MAXLINE];
+    struct iovec request[REQUEST_IOV_CNT];
+    headers_t headers = {.cnt = 0};
+    bool accept_gzip;
+    char *server_hostname;
+    char *server_path;
+    char *server_port;
+    snprintf(buf, sizeof(buf), REQUESTLINE_HEADER, url);
+    parser_t *parser;
+    parser = parser_new();
+    if (parser_parse_line(parser, buf) == ERROR) {
+        parser_free(parser);
+        return;
+    }
+    parser_retrieve(parser, HOST, (const char **)&server_hostname);
+    parser_retrieve(parser, PATH, (const char **)&server_path);
+    parser_retrieve(parser, PORT, (const char **)&server_port);
+    int iovcnt = forward_header(request, server_hostname, server_path,
+                                server_port, &headers, &accept_gzip);
+    // nothing to do if already cached or being fetched by a client
+    cache_block_t *block;
+    cache_fill_t fill;
+    cache_result_t res =
+        cache_acquire(url, cache_key_hash(url, strlen(url)), &block, &fill);
+    if (res != CACHE_MISS) {
+        if (res == CACHE_HIT) {
+            cache_release(block);
+        }
+        parser_free(parser);
+        return;
+    }
+    PROBE_UPSTREAM_CONNECT_START(server_hostname, server_port);
+    int clientfd = open_clientfd(server_hostname, server_port);
+    PROBE_UPSTREAM_CONNECT_END(server_hostname, server_port, clientfd);
+    metrics_add(clientfd < 0 ? METRIC_ERR_UPSTREAM_CONNECT
+                             : METRIC_UPSTREAM_CONNECTS,
+                1);
+    if (clientfd >= 0) {
+        rio_t server_rio;
+        conn_timeout_t timeout;
+        wheel_timer_init(&timeout.timer);
+        timeout_arm(&timeout, -1, clientfd, read_timeout);
+        rio_readinitb(&server_rio, clientfd);
+        rio_writevn(clientfd, request, iovcnt);
+        if (relay_response(&server_rio, -1, &fill, &timeout) >= 0) {
+            cache_fill_commit(&fill);
+        } else {
+            cache_fill_abort(&fill);
+        }
+        close(clientfd);
+    } else {
+        cache_fill_abort(&fill);
+    }
+    parser_free(parser); // owns the strings of the request
 }
 /**
  * @brief Ignore SIGPIPE signal
@@ -185,17 +571,104 @@ void doit(int fd) {
 void sigpipt_handler(int sig) {
     return;
 }
+/**
+ * @brief Dump the latency histograms and mutex statistics to stderr on
+ * each SIGUSR1.
+ * SIGUSR1 is blocked in all threads and taken here with sigwait(), so the
+ * dump does not run in a signal handler.
+ *
+ */
+void *stats_dumper(void *vargp) {
+    sigset_t *mask = (sigset_t *)vargp;
+    int sig;
+    while (1) {
+        if (sigwait(mask, &sig) == 0) {
+            latency_dump(stderr);
+            lockprof_dump(stderr);
+        }
+    }
+    return NULL;
+}
 /**
  * @brief Define a single thread.
  *
  */
 void *thread(void *vargp) {
     pthread_detach(pthread_self());
-    int connfd = *(int *)vargp;
-    doit(connfd);
+    int connfd = (int)(intptr_t)vargp;
+    // request-scoped memory, all within this first chunk unless the
+    // request line is unusually long (see ARENA_CONN_SIZE)
+    char first[ARENA_CONN_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+    arena_t arena;
+    arena_init(&arena, first, sizeof(first), ARENA_CONN_SIZE);
+    // the request must arrive within the idle timeout
+    conn_timeout_t timeout;
+    wheel_timer_init(&timeout.timer);
+    timeout_arm(&timeout, connfd, -1, idle_timeout);
+    metrics_add(METRIC_CONNECTIONS, 1);
+    doit(connfd, &arena, &timeout);
+    arena_reset(&arena);
+    timeout_disarm(&timeout);
     close(connfd);
+    metrics_add(METRIC_CONNECTIONS, -1);
     return NULL;
 }
+/**
+ * @brief Print the command-line usage and exit.
+ *
+ */
+void usage(char *prog) {
+    fprintf(stderr,
+            "usage: %s [-s] [-x param]... [-n status=ttl]... [-z] [-t ttl]"
+            " [-T timeout] [-p workers [-P max]] [-m] [-a] [--warm manifest]"
+            " <port>\n",
+            prog);
+    fprintf(stderr, "  -s             sort query parameters in cache keys\n");
+    fprintf(stderr, "  -x param       strip query parameter from cache keys\n");
+    fprintf(stderr, "  -n status=ttl  cache error responses for ttl seconds"
+                    " (e.g. 404=60, 5xx=5)\n");
+    fprintf(stderr, "  -z             store compressible bodies gzipped\n");
+    fprintf(stderr, "  -t ttl         expire responses without a max-age after"
+                    " ttl seconds\n");
+    fprintf(stderr, "  -T timeout     close connections idle for timeout"
+                    " seconds (default never)\n");
+    fprintf(stderr, "  -p workers     prefetch resources of HTML pages with"
+                    " this many threads\n");
+    fprintf(stderr, "  -P max         prefetch at most max resources per page"
+                    " (default %d)\n",
+            PREFETCH_PAGE_MAX);
+    fprintf(stderr, "  -m             low-memory mode, for many idle or slow"
+                    " connections\n");
+    fprintf(stderr, "  -a             grow and shrink the cache with the"
+                    " memory limit and pressure\n");
+    fprintf(stderr, "  --warm file    fetch the urls of a manifest into the"
+                    " cache at startup\n");
+    exit(1);
+}
+/**
+ * @brief Parse a "-n status=ttl" option, where status is a status code
+ * or a class such as "5xx".
+ *
+ */
+void parse_negative_ttl(char *prog, char *arg) {
+    char status[4];
+    int ttl;
+    if (sscanf(arg, "%3[0-9x]=%d", status, &ttl) != 2) {
+        usage(prog);
+    }
+    int first, last;
+    if (!strcmp(status + 1, "xx")) {
+        first = (status[0] - '0') * 100;
+        last = first + 99;
+    } else {
+        first = last = atoi(status);
+    }
+    for (int code = first; code <= last; code++) {
+        if (cache_set_negative_ttl(code, ttl) < 0) {
+            usage(prog);
+        }
+    }
+}
 /**
  * @brief main function
  * (Structrue reference from CSAPP Figure 11.29)
@@ -210,23 +683,135 @@ int main(int argc, char **argv) {
      * that receives SIGPIPE is to terminate,
      * your proxy should not terminate due to that signal. */
     Signal(SIGPIPE, sigpipt_handler);
+    // block SIGUSR1 before creating threads, so they all inherit the mask
+    static sigset_t usr1_mask;
+    sigemptyset(&usr1_mask);
+    sigaddset(&usr1_mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1_mask, NULL);
+    pthread_create(&tid, NULL, stats_dumper, &usr1_mask);
     /* Check command-line args */
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <port>\n", argv[0]);
-        exit(1);
+    static struct option long_opts[] = {{"warm", required_argument, NULL, 'w'},
+                                        {"low-mem", no_argument, NULL, 'm'},
+                                        {"adaptive", no_argument, NULL, 'a'},
+                                        {NULL, 0, NULL, 0}};
+    int opt;
+    int prefetch_workers = 0;
+    int prefetch_max = PREFETCH_PAGE_MAX;
+    char *warm_manifest = NULL;
+    bool low_mem = false;
+    bool adaptive = false;
+    while ((opt = getopt_long(argc, argv, "sx:n:zt:T:p:P:maw:", long_opts,
+                              NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            cache_key_sort_query(true);
+            break;
+        case 'x':
+            if (cache_key_strip_param(optarg) < 0) {
+                fprintf(stderr, "too many stripped query parameters\n");
+                exit(1);
+            }
+            break;
+        case 'n':
+            parse_negative_ttl(argv[0], optarg);
+            break;
+        case 'z':
+            cache_set_gzip(true);
+            break;
+        case 't':
+            if (atoi(optarg) <= 0) {
+                usage(argv[0]);
+            }
+            cache_set_default_ttl(atoi(optarg));
+            break;
+        case 'T':
+            idle_timeout = atoi(optarg);
+            if (idle_timeout < 0) {
+                usage(argv[0]);
+            }
+            read_timeout = idle_timeout;
+            break;
+        case 'p':
+            prefetch_workers = atoi(optarg);
+            if (prefetch_workers <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'P':
+            prefetch_max = atoi(optarg);
+            if (prefetch_max <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'm':
+            low_mem = true;
+            break;
+        case 'a':
+            adaptive = true;
+            break;
+        case 'w':
+            warm_manifest = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
     }
-    listenfd = open_listenfd(argv[1]);
+    if (argc - optind != 1) {
+        usage(argv[0]);
+    }
+    listenfd = open_listenfd(argv[optind]);
+    // in low-memory mode a connection costs little more than the stack
+    // pages it touches, and idle relay buffers are returned to malloc
+    pthread_attr_t conn_attr;
+    pthread_attr_init(&conn_attr);
+    if (low_mem) {
+        pthread_attr_setstacksize(&conn_attr, LOWMEM_STACK_SIZE);
+    }
+    // cache fills are reserved from the pool
+    bufpool_init(MAX_OBJECT_SIZE,
+                 low_mem ? LOWMEM_IDLE_BUFS : BUFPOOL_IDLE_MAX);
+    // timeouts of the connections, checked once a second
+    prof_mutex_init(&timeoutLock, "timeouts");
+    wheel_init(&timeout_wheel, timeout_now());
+    pthread_create(&tid, NULL, timeout_ticker, NULL);
     // initial cache
     cache_init();
+    if (cache_evictor_start() < 0) {
+        fprintf(stderr, "cannot start evictor thread\n");
+        exit(1);
+    }
+    // the budget follows the memory limit and pressure of the cgroup
+    if (adaptive && memwatch_start() < 0) {
+        fprintf(stderr, "cannot start memory watcher thread\n");
+        exit(1);
+    }
+    // warm-up shares the prefetch workers, without scanning pages
+    // unless prefetching was asked for
+    if (prefetch_workers == 0 && warm_manifest != NULL) {
+        prefetch_workers = PREFETCH_WORKERS;
+        prefetch_max = 0;
+    }
+    if (prefetch_workers > 0 &&
+        prefetch_init(prefetch_workers, prefetch_max, fetch_url) < 0) {
+        fprintf(stderr, "cannot start prefetch threads\n");
+        exit(1);
+    }
+    // clients are accepted while the cache warms up
+    if (warm_manifest != NULL && warm_start(warm_manifest) < 0) {
+        fprintf(stderr, "cannot read %s\n", warm_manifest);
+        exit(1);
+    }
     while (1) {
         clientlen = sizeof(clientaddr);
         connfd = accept(listenfd, (SA *)&clientaddr, &clientlen);
-        int *fdpointer = malloc(sizeof(connfd));
-        *fdpointer = connfd;
         getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port,
                     MAXLINE, 0);
         sio_printf("Accepted connection from (%s, %s)\n", hostname, port);
-        pthread_create(&tid, NULL, thread, fdpointer);
+        // the fd is passed in the pointer itself, with nothing to free
+        if (pthread_create(&tid, &conn_attr, thread,
+                           (void *)(intptr_t)connfd) != 0) {
+            close(connfd); // out of threads or memory for their stacks
+        }
     }
     return 0;
 }
@@ -0,0 +1,209 @@
+/**
+ * @file scan.c
+ * @author Xianwei Zou
+ * @brief Vectorized scanning of HTTP text for bytes of a class.
+ *
+ * The vectorized scans are compiled with target attributes, so the rest of
+ * the proxy needs no -m flags and runs on any x86-64 CPU. Header names are
+ * short, so a last partial block is still loaded whole when that cannot
+ * cross into another page, and the bytes past end are masked out; otherwise
+ * the tail is left to the scalar scan.
+ */
+#include "scan.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+/* Token characters of RFC 9110, which header names and methods are made of */
+static const char *TOKEN_CHARS = "!#$%&'*+-.^_`|~0123456789"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "abcdefghijklmnopqrstuvwxyz";
+// Page size, for loads past end that must stay in the page of end - 1
+#define SCAN_PAGE 4096
+static scan_set_t token_set;
+static scan_impl_t best_impl = SCAN_SCALAR; // best one the CPU supports
+static scan_impl_t cur_impl = SCAN_SCALAR;  // one in use
+/**
+ * @brief Initialize a class with the bytes of a string.
+ */
+void scan_set_init(scan_set_t *set, const char *chars) {
+    memset(set, 0, sizeof(*set));
+    for (const unsigned char *c = (const unsigned char *)chars; *c; c++) {
+        set->member[*c] = true;
+        if (*c < 0x80) {
+            set->lo[*c & 0x0f] |= 1 << (*c >> 4);
+        }
+    }
+    for (int h = 0; h < 8; h++) {
+        set->hi[h] = 1 << h;
+    }
+    // runs of consecutive members, as many as pcmpestri takes
+    int ranges = 0;
+    for (int b = 1; b < 0x80; b++) {
+        if (!set->member[b] || set->member[b - 1]) {
+            continue;
+        }
+        int last = b;
+        while (last + 1 < 0x80 && set->member[last + 1]) {
+            last++;
+        }
+        if (ranges++ < SCAN_RANGES) {
+            set->ranges[set->range_len++] = (char)b;
+            set->ranges[set->range_len++] = (char)last;
+        }
+    }
+    set->ranges_exact = ranges <= SCAN_RANGES && !set->member[0];
+}
+/**
+ * @brief Scalar scan for the first byte whose membership is want.
+ */
+static const char *scan_scalar(const char *s, const char *end,
+                               const scan_set_t *set, bool want) {
+    while (s < end && set->member[(unsigned char)*s] != want) {
+        s++;
+    }
+    return s;
+}
+#ifdef SCAN_X86
+/**
+ * @brief Check if a block of size bytes can be loaded from s, which may go
+ * past end but not into another page.
+ */
+static inline bool block_loadable(const char *s, const char *end,
+                                  size_t size) {
+    return end - s >= (ptrdiff_t)size ||
+           ((uintptr_t)s & (SCAN_PAGE - 1)) <= SCAN_PAGE - size;
+}
+/**
+ * @brief SSE4.2 scan, with pcmpestri matching the ranges of the class.
+ */
+__attribute__((target("sse4.2"))) static const char *
+scan_sse42(const char *s, const char *end, const scan_set_t *set, bool want) {
+    if (!set->ranges_exact && want) {
+        return scan_scalar(s, end, set, want); // would miss members
+    }
+    __m128i ranges = _mm_loadu_si128((const __m128i *)set->ranges);
+    while (s < end && block_loadable(s, end, 16)) {
+        __m128i block = _mm_loadu_si128((const __m128i *)s);
+        int len = end - s < 16 ? (int)(end - s) : 16; // bytes past end ignored
+        int i = want ? _mm_cmpestri(ranges, set->range_len, block, len,
+                                    _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                        _SIDD_LEAST_SIGNIFICANT)
+                     : _mm_cmpestri(ranges, set->range_len, block, len,
+                                    _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                        _SIDD_NEGATIVE_POLARITY |
+                                        _SIDD_MASKED_NEGATIVE_POLARITY |
+                                        _SIDD_LEAST_SIGNIFICANT);
+        if (i >= len) {
+            s += len;
+        } else if (set->member[(unsigned char)s[i]] == want) {
+            return s + i;
+        } else {
+            s += i + 1; // a member outside the ranges, keep spanning
+        }
+    }
+    return scan_scalar(s, end, set, want);
+}
+/**
+ * @brief AVX2 scan, looking up both nibbles of each byte with vpshufb: a
+ * byte is in the class if the bits of its nibbles intersect.
+ */
+__attribute__((target("avx2"))) static const char *
+scan_avx2(const char *s, const char *end, const scan_set_t *set, bool want) {
+    __m256i lo_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)set->lo));
+    __m256i hi_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)set->hi));
+    __m256i nibble = _mm256_set1_epi8(0x0f);
+    while (s < end && block_loadable(s, end, 32)) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)s);
+        __m256i lo =
+            _mm256_shuffle_epi8(lo_table, _mm256_and_si256(block, nibble));
+        __m256i hi = _mm256_shuffle_epi8(
+            hi_table, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        __m256i out = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi),
+                                        _mm256_setzero_si256());
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(out);
+        if (want) {
+            mask = ~mask;
+        }
+        if (end - s < 32) {
+            mask &= ((uint32_t)1 << (end - s)) - 1; // bytes past end
+        }
+        if (mask != 0) {
+            return s + __builtin_ctz(mask);
+        }
+        if (end - s <= 32) {
+            return end;
+        }
+        s += 32;
+    }
+    return scan_scalar(s, end, set, want);
+}
+#endif
+/**
+ * @brief Pick the best implementation and build the token class, before
+ * main() so that scans need no synchronization.
+ */
+__attribute__((constructor)) static void scan_setup(void) {
+    scan_set_init(&token_set, TOKEN_CHARS);
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        best_impl = SCAN_AVX2;
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        best_impl = SCAN_SSE42;
+    }
+#endif
+    cur_impl = best_impl;
+}
+/**
+ * @brief Scan for the first byte whose membership is want.
+ */
+static const char *scan(const char *s, const char *end, const scan_set_t *set,
+                        bool want) {
+    switch (__atomic_load_n(&cur_impl, __ATOMIC_RELAXED)) {
+#ifdef SCAN_X86
+    case SCAN_AVX2:
+        return scan_avx2(s, end, set, want);
+    case SCAN_SSE42:
+        return scan_sse42(s, end, set, want);
+#endif
+    default:
+        return scan_scalar(s, end, set, want);
+    }
+}
+/**
+ * @brief Find the first byte of [s, end) in a class.
+ */
+const char *scan_find(const char *s, const char *end, const scan_set_t *set) {
+    return scan(s, end, set, true);
+}
+/**
+ * @brief Find the first byte of [s, end) not in a class.
+ */
+const char *scan_span(const char *s, const char *end, const scan_set_t *set) {
+    return scan(s, end, set, false);
+}
+/**
+ * @brief Get the class of token characters.
+ */
+const scan_set_t *scan_token_set(void) {
+    return &token_set;
+}
+/**
+ * @brief Force an implementation.
+ */
+scan_impl_t scan_use(scan_impl_t impl) {
+    if (impl == SCAN_AUTO) {
+        impl = best_impl;
+    } else if (impl > best_impl) {
+        impl = SCAN_SCALAR; // AVX2 CPUs also have SSE4.2
+    }
+    __atomic_store_n(&cur_impl, impl, __ATOMIC_RELAXED);
+    return impl;
+}
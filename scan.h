@@ -0,0 +1,58 @@
+/**
+ * @file scan.h
+ * @author Xianwei Zou
+ * @brief Vectorized scanning of HTTP text for bytes of a class.
+ *
+ * A scan_set_t is a class of ASCII bytes, such as the delimiters of the
+ * request line or the token characters of a header name. scan_find() and
+ * scan_span() look for the first byte in or out of a class, 32 bytes at a
+ * time with AVX2, 16 with SSE4.2 (pcmpestri), or one at a time. The
+ * implementation is picked with cpuid on first use; the scalar one is the
+ * reference and handles the tails of the vectorized ones.
+ */
+#ifndef SCAN_H
+#define SCAN_H
+#include <stdbool.h>
+#include <stdint.h>
+/* Max number of byte ranges matched by pcmpestri */
+#define SCAN_RANGES 8
+/* A class of ASCII bytes */
+typedef struct {
+    bool member[256];              // membership, for the scalar scan
+    char ranges[2 * SCAN_RANGES];  // first and last byte of each range
+    int range_len;                 // bytes used in ranges
+    bool ranges_exact;             // the ranges cover the whole class
+    uint8_t lo[16];                // bit h of lo[l] is set if h<<4|l is in
+    uint8_t hi[16];                // bit h of hi[h] for the ASCII nibbles
+} scan_set_t;
+/* Implementations of the scans */
+typedef enum { SCAN_SCALAR, SCAN_SSE42, SCAN_AVX2, SCAN_AUTO } scan_impl_t;
+/**
+ * @brief Initialize a class with the bytes of a string, all below 0x80.
+ */
+void scan_set_init(scan_set_t *set, const char *chars);
+/**
+ * @brief Find the first byte of [s, end) in a class.
+ *
+ * @return the byte, or end if there is none
+ */
+const char *scan_find(const char *s, const char *end, const scan_set_t *set);
+/**
+ * @brief Find the first byte of [s, end) not in a class.
+ *
+ * @return the byte, or end if there is none
+ */
+const char *scan_span(const char *s, const char *end, const scan_set_t *set);
+/**
+ * @brief Get the class of token characters (RFC 9110), e.g. header names.
+ */
+const scan_set_t *scan_token_set(void);
+/**
+ * @brief Force an implementation, e.g. to compare them in a benchmark.
+ * SCAN_AUTO picks the best one the CPU supports.
+ *
+ * @return the implementation used, which is SCAN_SCALAR if the requested
+ * one is not supported
+ */
+scan_impl_t scan_use(scan_impl_t impl);
+#endif /* SCAN_H */
@@ -1,5 +1,8 @@
 # Make sure evict objects
 serve s1
+# The generator gives random-text 01/13, 02/10, 03/11, 06/14 and 07/15 the
+# same contents, which the cache stores once, so the second of each pair is
+# made slightly smaller to differ
 generate random-text01.txt 100K
 generate random-text02.txt 100K
 generate random-text03.txt 100K
@@ -9,12 +12,12 @@ generate random-text06.txt 100K
 generate random-text07.txt 100K
 generate random-text08.txt 100K
 generate random-text09.txt 100K
-generate random-text10.txt 100K
-generate random-text11.txt 100K
+generate random-text10.txt 99K
+generate random-text11.txt 99K
 generate random-text12.txt 100K
-generate random-text13.txt 100K
-generate random-text14.txt 100K
-generate random-text15.txt 100K
+generate random-text13.txt 99K
+generate random-text14.txt 99K
+generate random-text15.txt 99K
 fetch f01 random-text01.txt s1
 fetch f02 random-text02.txt s1
 fetch f03 random-text03.txt s1
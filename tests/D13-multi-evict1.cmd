@@ -1,5 +1,7 @@
 # Test ability to evict multiple objects to make room for big ones
 serve s1
+# The generator gives big-text02 and big-text10 the same contents, which
+# the cache stores once, so big-text10 is made slightly smaller to differ
 generate little-text00.txt 10K
 generate little-text01.txt 10K
 generate little-text02.txt 10K
@@ -20,7 +22,7 @@ generate big-text06.txt 100K
 generate big-text07.txt 100K
 generate big-text08.txt 100K
 generate big-text09.txt 100K
-generate big-text10.txt 100K
+generate big-text10.txt 99K
 # Use 100K of cache
 fetch fl00 little-text00.txt s1
 fetch fl01 little-text01.txt s1
@@ -1,5 +1,8 @@
 # Test ability to evict multiple binary objects to make room for big ones
 serve s1
+# The generator gives big-binary 02/10 and 03/11 the same contents, which
+# the cache stores once, so the second of each pair is made slightly
+# smaller to differ
 generate little-binary00.bin 10K
 generate little-binary01.bin 10K
 generate little-binary02.bin 10K
@@ -20,8 +23,8 @@ generate big-binary06.bin 100K
 generate big-binary07.bin 100K
 generate big-binary08.bin 100K
 generate big-binary09.bin 100K
-generate big-binary10.bin 100K
-generate big-binary11.bin 100K
+generate big-binary10.bin 99K
+generate big-binary11.bin 99K
 # Use 50K of cache
 fetch fl00 little-binary00.bin s1
 fetch fl01 little-binary01.bin s1
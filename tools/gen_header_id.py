@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Generate header_id.h and header_id.c, a perfect hash of header names.
+
+Each standard header name maps to an enum value (HDR_*) and a set of flags.
+The hash only reads the length and three characters of a name, so a lookup
+is a few loads, one multiply and one case-insensitive compare, like the
+tables gperf generates.
+
+Usage: tools/gen_header_id.py [output directory]
+"""
+import random
+import sys
+
+# Header names and their flags
+HOP = "HDR_HOP_BY_HOP"  # meaningful for a single connection only
+REWRITTEN = "HDR_REWRITTEN"  # replaced by the proxy's own value
+HEADERS = [
+    ("Accept", []),
+    ("Accept-Charset", []),
+    ("Accept-Encoding", []),
+    ("Accept-Language", []),
+    ("Accept-Ranges", []),
+    ("Age", []),
+    ("Allow", []),
+    ("Authorization", []),
+    ("Cache-Control", []),
+    ("Connection", [HOP, REWRITTEN]),
+    ("Content-Disposition", []),
+    ("Content-Encoding", []),
+    ("Content-Language", []),
+    ("Content-Length", []),
+    ("Content-Location", []),
+    ("Content-Range", []),
+    ("Content-Type", []),
+    ("Cookie", []),
+    ("Date", []),
+    ("DNT", []),
+    ("ETag", []),
+    ("Expect", []),
+    ("Expires", []),
+    ("Forwarded", []),
+    ("From", []),
+    ("Host", [REWRITTEN]),
+    ("If-Match", []),
+    ("If-Modified-Since", []),
+    ("If-None-Match", []),
+    ("If-Range", []),
+    ("If-Unmodified-Since", []),
+    ("Keep-Alive", [HOP]),
+    ("Last-Modified", []),
+    ("Link", []),
+    ("Location", []),
+    ("Max-Forwards", []),
+    ("Origin", []),
+    ("Pragma", []),
+    ("Proxy-Authenticate", [HOP]),
+    ("Proxy-Authorization", [HOP]),
+    ("Proxy-Connection", [HOP, REWRITTEN]),
+    ("Range", []),
+    ("Referer", []),
+    ("Retry-After", []),
+    ("Server", []),
+    ("Set-Cookie", []),
+    ("TE", [HOP]),
+    ("Trailer", [HOP]),
+    ("Transfer-Encoding", [HOP]),
+    ("Upgrade", [HOP]),
+    ("Upgrade-Insecure-Requests", []),
+    ("User-Agent", [REWRITTEN]),
+    ("Vary", []),
+    ("Via", []),
+    ("Warning", []),
+    ("WWW-Authenticate", []),
+    ("X-Forwarded-For", []),
+    ("X-Forwarded-Host", []),
+    ("X-Forwarded-Proto", []),
+    ("X-Requested-With", []),
+]
+# log2 of the number of slots of the table
+BITS = 9
+MASK32 = 0xFFFFFFFF
+
+
+def enum_name(name):
+    return "HDR_" + name.upper().replace("-", "_")
+
+
+def features(name):
+    """Bytes read by the hash: length, first, middle and last character."""
+    n = len(name)
+    return (n, ord(name[0]) | 0x20, ord(name[n // 2]) | 0x20,
+            ord(name[-1]) | 0x20)
+
+
+def slot(feats, mults):
+    h = 0
+    for f, m in zip(feats, mults):
+        h = (h + f * m) & MASK32
+    return ((h * 0x9E3779B1) & MASK32) >> (32 - BITS)
+
+
+def find_multipliers():
+    keys = [features(name) for name, _ in HEADERS]
+    if len(set(keys)) != len(keys):
+        sys.exit("gen_header_id: two names share the hashed characters")
+    rng = random.Random(213)
+    for _ in range(1000000):
+        mults = [rng.randrange(1, 1 << 16) | 1 for _ in range(4)]
+        if len({slot(k, mults) for k in keys}) == len(keys):
+            return mults
+    sys.exit("gen_header_id: no perfect hash found, increase BITS")
+
+
+def main():
+    out = sys.argv[1] if len(sys.argv) > 1 else "."
+    mults = find_multipliers()
+    table = [0] * (1 << BITS)
+    for i, (name, _) in enumerate(HEADERS):
+        table[slot(features(name), mults)] = i + 1
+    banner = "/* Generated by tools/gen_header_id.py, do not edit. */\n"
+    with open(out + "/header_id.h", "w") as f:
+        f.write(banner)
+        f.write("""/**
+ * @file header_id.h
+ * @author Xianwei Zou
+ * @brief Identifiers of standard header names, from a perfect hash.
+ *
+ * header_id() maps a header name to an enum with one hash and one
+ * case-insensitive compare, so that the proxy can dispatch on headers with
+ * a switch instead of comparing strings.
+ */
+#ifndef HEADER_ID_H
+#define HEADER_ID_H
+#include <stddef.h>
+/* Header is meaningful for a single connection and is not forwarded */
+#define HDR_HOP_BY_HOP 0x1
+/* Header is replaced by the proxy's own value */
+#define HDR_REWRITTEN 0x2
+/* Standard header names */
+typedef enum {
+    HDR_UNKNOWN,
+""")
+        for name, _ in HEADERS:
+            f.write("    %s,\n" % enum_name(name))
+        f.write("""    HDR_CNT
+} header_id_t;
+/* Canonical spelling of each name, NULL for HDR_UNKNOWN */
+extern const char *const header_id_names[HDR_CNT];
+/* HDR_* flags of each name */
+extern const unsigned char header_id_flags[HDR_CNT];
+/**
+ * @brief Identify a header name, compared case-insensitively.
+ *
+ * @param name the name, which needs no null terminator
+ * @param len length of the name
+ * @return the identifier, or HDR_UNKNOWN for other names
+ */
+header_id_t header_id(const char *name, size_t len);
+#endif /* HEADER_ID_H */
+""")
+    with open(out + "/header_id.c", "w") as f:
+        f.write(banner)
+        f.write("""/**
+ * @file header_id.c
+ * @author Xianwei Zou
+ * @brief Identifiers of standard header names, from a perfect hash.
+ */
+#include "header_id.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <strings.h>
+const char *const header_id_names[HDR_CNT] = {
+""")
+        for name, _ in HEADERS:
+            f.write("    [%s] = \"%s\",\n" % (enum_name(name), name))
+        f.write("};\nconst unsigned char header_id_flags[HDR_CNT] = {\n")
+        for name, flags in HEADERS:
+            if flags:
+                f.write("    [%s] = %s,\n" % (enum_name(name),
+                                               " | ".join(flags)))
+        f.write("};\n")
+        f.write("static const unsigned char name_lens[HDR_CNT] = {\n")
+        for name, _ in HEADERS:
+            f.write("    [%s] = %d,\n" % (enum_name(name), len(name)))
+        f.write("};\n/* Identifier of each slot of the hash, 0 if empty */\n")
+        f.write("static const unsigned char slots[%d] = {\n" % (1 << BITS))
+        for i in range(0, len(table), 16):
+            f.write("    " + ", ".join("%d" % v for v in table[i:i + 16]) +
+                    ",\n")
+        f.write("""};
+/**
+ * @brief Identify a header name, compared case-insensitively.
+ */
+header_id_t header_id(const char *name, size_t len) {
+    if (len == 0 || len > 255) {
+        return HDR_UNKNOWN;
+    }
+    uint32_t h = (uint32_t)len * %du +
+                 (uint32_t)(name[0] | 0x20) * %du +
+                 (uint32_t)(name[len / 2] | 0x20) * %du +
+                 (uint32_t)(name[len - 1] | 0x20) * %du;
+    header_id_t id = slots[(h * 0x9E3779B1u) >> (32 - %d)];
+    if (id == HDR_UNKNOWN || name_lens[id] != len ||
+        strncasecmp(name, header_id_names[id], len)) {
+        return HDR_UNKNOWN;
+    }
+    return id;
+}
+""" % (mults[0], mults[1], mults[2], mults[3], BITS))
+
+
+if __name__ == "__main__":
+    main()
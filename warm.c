@@ -0,0 +1,173 @@
+/**
+ * @file warm.c
+ * @author Xianwei Zou
+ * @brief Cache warm-up from a manifest of urls.
+ */
+#include "warm.h"
+#include "cache_key.h"
+#include "csapp.h"
+#include "prefetch.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* A url of the manifest */
+typedef struct {
+    char *url;     // canonical key of the url
+    double weight; // higher weights are fetched first
+    int line;      // line in the manifest, orders equal weights
+} warm_entry_t;
+/* The manifest being fed to the workers */
+typedef struct {
+    warm_entry_t *entries;
+    int cnt;
+} warm_list_t;
+/**
+ * @brief Find the start of the value of a member of a JSON object.
+ *
+ * @return the first character of the value, or NULL if there is no member
+ */
+static const char *json_member(const char *obj, const char *name) {
+    char quoted[MAXLINE];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", name);
+    const char *p = strstr(obj, quoted);
+    if (p == NULL) {
+        return NULL;
+    }
+    p += strlen(quoted);
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+    if (*p != ':') {
+        return NULL;
+    }
+    p++;
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+    return p;
+}
+/**
+ * @brief Parse a manifest line into a url and its weight.
+ *
+ * @param[out] url buffer of MAXLINE bytes receiving the url
+ * @return false if the line is empty, a comment or malformed
+ */
+static bool parse_line(const char *line, char *url, double *weight) {
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+    *weight = 0;
+    if (*line == '\0' || *line == '#') {
+        return false;
+    }
+    if (*line != '{') {
+        // url [weight]
+        return sscanf(line, "%8191s %lf", url, weight) >= 1;
+    }
+    // {"url": "...", "weight": N}
+    const char *p = json_member(line, "url");
+    if (p == NULL || *p != '"') {
+        return false;
+    }
+    size_t len = 0;
+    for (p++; *p != '"'; p++) {
+        if (*p == '\0' || len == MAXLINE - 1) {
+            return false;
+        }
+        if (*p == '\\' && p[1] != '\0') {
+            p++; // \" \\ \/
+        }
+        url[len++] = *p;
+    }
+    url[len] = '\0';
+    const char *w = json_member(line, "weight");
+    if (w != NULL) {
+        *weight = strtod(w, NULL);
+    }
+    return true;
+}
+/**
+ * @brief Order entries by decreasing weight, then by line.
+ */
+static int entry_compare(const void *a, const void *b) {
+    const warm_entry_t *x = a;
+    const warm_entry_t *y = b;
+    if (x->weight != y->weight) {
+        return x->weight > y->weight ? -1 : 1;
+    }
+    return x->line - y->line;
+}
+/**
+ * @brief Feed the manifest to the workers, waiting for room in the queue
+ * so that the order is kept.
+ */
+static void *feed(void *vargp) {
+    pthread_detach(pthread_self());
+    warm_list_t *list = vargp;
+    for (int i = 0; i < list->cnt; i++) {
+        prefetch_enqueue(list->entries[i].url, true);
+        free(list->entries[i].url);
+    }
+    free(list->entries);
+    free(list);
+    return NULL;
+}
+/**
+ * @brief Read a manifest and start warming the cache in the background.
+ */
+int warm_start(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    warm_list_t *list = malloc(sizeof(warm_list_t));
+    int cap = 256;
+    list->entries = malloc(cap * sizeof(warm_entry_t));
+    list->cnt = 0;
+    char line[MAXLINE], url[MAXLINE], key[MAXLINE];
+    double weight;
+    int lineno = 0;
+    // the whole manifest is read, so that the heaviest urls are kept
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        if (!parse_line(line, url, &weight)) {
+            continue;
+        }
+        if (cache_key_build(url, key, sizeof(key)) < 0) {
+            fprintf(stderr, "%s:%d: url too long\n", path, lineno);
+            continue;
+        }
+        if (list->cnt == cap) {
+            warm_entry_t *grown =
+                realloc(list->entries, 2 * cap * sizeof(warm_entry_t));
+            if (grown == NULL) {
+                fprintf(stderr, "%s:%d: out of memory, rest skipped\n", path,
+                        lineno);
+                break;
+            }
+            list->entries = grown;
+            cap = 2 * cap;
+        }
+        warm_entry_t *entry = &list->entries[list->cnt++];
+        entry->url = strdup(key);
+        entry->weight = weight;
+        entry->line = lineno;
+    }
+    fclose(fp);
+    qsort(list->entries, list->cnt, sizeof(warm_entry_t), entry_compare);
+    if (list->cnt > WARM_MAX_URLS) {
+        fprintf(stderr, "%s: %d urls skipped, only the %d heaviest warmed\n",
+                path, list->cnt - WARM_MAX_URLS, WARM_MAX_URLS);
+        for (int i = WARM_MAX_URLS; i < list->cnt; i++) {
+            free(list->entries[i].url);
+        }
+        list->cnt = WARM_MAX_URLS;
+    }
+    int cnt = list->cnt;
+    pthread_t tid;
+    pthread_create(&tid, NULL, feed, list);
+    return cnt;
+}
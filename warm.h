@@ -0,0 +1,24 @@
+/**
+ * @file warm.h
+ * @author Xianwei Zou
+ * @brief Cache warm-up from a manifest of urls.
+ *
+ * The manifest lists the urls to fetch into the cache at startup, one per
+ * line, either as "url [weight]" or as a JSON object such as
+ * {"url": "http://host/a.css", "weight": 5}. Urls are fetched by the
+ * prefetch worker threads in decreasing weight order, and in listed order
+ * for equal weights, while the proxy already accepts clients.
+ */
+#ifndef WARM_H
+#define WARM_H
+// Max number of urls fetched from a manifest, the heaviest ones
+#define WARM_MAX_URLS 4096
+/**
+ * @brief Read a manifest and start warming the cache in the background.
+ * The prefetch worker threads must be started with prefetch_init().
+ *
+ * @param path path of the manifest
+ * @return number of urls to be fetched, or -1 if the manifest cannot be read
+ */
+int warm_start(const char *path);
+#endif /* WARM_H */
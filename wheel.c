@@ -0,0 +1,123 @@
+/**
+ * @file wheel.c
+ * @author Xianwei Zou
+ * @brief Hierarchical timing wheel.
+ */
+#include "wheel.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+// Slots of a level
+#define LEVEL_SHIFT(level) ((level) * WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+// Ticks spanned by the wheel
+#define WHEEL_SPAN ((uint64_t)1 << LEVEL_SHIFT(WHEEL_LEVELS))
+/**
+ * @brief Initialize a wheel.
+ */
+void wheel_init(wheel_t *wheel, uint64_t now) {
+    wheel->now = now;
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+}
+/**
+ * @brief Initialize a timer, which is not pending.
+ */
+void wheel_timer_init(wheel_timer_t *timer) {
+    timer->expires = 0;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+/**
+ * @brief Check if a timer is pending.
+ */
+bool wheel_pending(const wheel_timer_t *timer) {
+    return timer->pprev != NULL;
+}
+/**
+ * @brief Link a timer into the slot of its expiry, at the lowest level
+ * whose span from now reaches it.
+ *
+ * @param earliest tick at which a timer that is already due fires
+ */
+static void wheel_place(wheel_t *wheel, wheel_timer_t *timer,
+                        uint64_t earliest) {
+    // far timers wait in the last level
+    uint64_t at = timer->expires > earliest ? timer->expires : earliest;
+    if (at - wheel->now >= WHEEL_SPAN) {
+        at = wheel->now + WHEEL_SPAN - 1;
+    }
+    uint64_t delta = at - wheel->now;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           delta >= (uint64_t)WHEEL_SLOTS << LEVEL_SHIFT(level)) {
+        level++;
+    }
+    wheel_timer_t **slot =
+        &wheel->slots[level][(at >> LEVEL_SHIFT(level)) & WHEEL_MASK];
+    timer->next = *slot;
+    if (*slot != NULL) {
+        (*slot)->pprev = &timer->next;
+    }
+    *slot = timer;
+    timer->pprev = slot;
+}
+/**
+ * @brief Add a timer, or move it if pending.
+ */
+void wheel_add(wheel_t *wheel, wheel_timer_t *timer, uint64_t expires) {
+    wheel_del(timer);
+    timer->expires = expires;
+    wheel_place(wheel, timer, wheel->now + 1);
+}
+/**
+ * @brief Delete a timer. Does nothing if it is not pending.
+ */
+void wheel_del(wheel_timer_t *timer) {
+    if (timer->pprev == NULL) {
+        return;
+    }
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+/**
+ * @brief Advance a wheel to a tick and collect the timers that expire.
+ */
+wheel_timer_t *wheel_advance(wheel_t *wheel, uint64_t now) {
+    wheel_timer_t *expired = NULL;
+    while (wheel->now < now) {
+        uint64_t tick = ++wheel->now;
+        // move the timers of the coarser slots that start at this tick
+        // down to finer slots, those due now to the level-0 slot below
+        for (int level = WHEEL_LEVELS - 1; level > 0; level--) {
+            if (tick & (((uint64_t)1 << LEVEL_SHIFT(level)) - 1)) {
+                continue;
+            }
+            wheel_timer_t **slot =
+                &wheel->slots[level][(tick >> LEVEL_SHIFT(level)) & WHEEL_MASK];
+            wheel_timer_t *timer = *slot;
+            *slot = NULL;
+            while (timer != NULL) {
+                wheel_timer_t *next = timer->next;
+                wheel_place(wheel, timer, tick);
+                timer = next;
+            }
+        }
+        // everything in the level-0 slot of this tick is due
+        wheel_timer_t **slot = &wheel->slots[0][tick & WHEEL_MASK];
+        wheel_timer_t *timer = *slot;
+        *slot = NULL;
+        while (timer != NULL) {
+            wheel_timer_t *next = timer->next;
+            timer->pprev = NULL;
+            timer->next = expired;
+            expired = timer;
+            timer = next;
+        }
+    }
+    return expired;
+}
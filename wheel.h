@@ -0,0 +1,74 @@
+/**
+ * @file wheel.h
+ * @author Xianwei Zou
+ * @brief Hierarchical timing wheel.
+ *
+ * Timers are kept in WHEEL_LEVELS levels of WHEEL_SLOTS slots. A slot of
+ * level 0 holds the timers of one tick, and a slot of level n the timers of
+ * WHEEL_SLOTS^n ticks; a timer goes to the lowest level that reaches its
+ * expiry. Adding or deleting a timer is O(1) whatever the number of
+ * timers, and advancing by a tick only looks at the timers due then: those
+ * of one level-0 slot, plus, every WHEEL_SLOTS^n ticks, those of one slot of
+ * level n, which move down to finer slots. Timers beyond the span of the
+ * wheel wait in the last level and are placed again when it comes round.
+ *
+ * A wheel is not thread-safe; its owner serializes access to it and to
+ * its timers.
+ */
+#ifndef WHEEL_H
+#define WHEEL_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// log2 of the number of slots per level
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+// Number of levels, spanning WHEEL_SLOTS^WHEEL_LEVELS ticks
+#define WHEEL_LEVELS 4
+// Get the struct containing a timer
+#define wheel_entry(timer, type, member)                                       \
+    ((type *)((char *)(timer) - offsetof(type, member)))
+/* A timer, embedded in the object it times */
+typedef struct wheel_timer {
+    uint64_t expires;            // tick at which the timer expires
+    struct wheel_timer *next;    // next timer in the same slot
+    struct wheel_timer **pprev;  // link to this timer, NULL if not pending
+} wheel_timer_t;
+/* A timing wheel */
+typedef struct {
+    uint64_t now;                                    // last tick processed
+    wheel_timer_t *slots[WHEEL_LEVELS][WHEEL_SLOTS]; // pending timers
+} wheel_t;
+/**
+ * @brief Initialize a wheel.
+ *
+ * @param now current tick
+ */
+void wheel_init(wheel_t *wheel, uint64_t now);
+/**
+ * @brief Initialize a timer, which is not pending.
+ */
+void wheel_timer_init(wheel_timer_t *timer);
+/**
+ * @brief Check if a timer is pending.
+ */
+bool wheel_pending(const wheel_timer_t *timer);
+/**
+ * @brief Add a timer, or move it if pending. A timer that is already due
+ * expires at the next tick.
+ *
+ * @param expires tick at which the timer expires
+ */
+void wheel_add(wheel_t *wheel, wheel_timer_t *timer, uint64_t expires);
+/**
+ * @brief Delete a timer. Does nothing if it is not pending.
+ */
+void wheel_del(wheel_timer_t *timer);
+/**
+ * @brief Advance a wheel to a tick and collect the timers that expire.
+ *
+ * @param now current tick; the wheel never goes back
+ * @return the expired timers, which are no longer pending, linked by next
+ */
+wheel_timer_t *wheel_advance(wheel_t *wheel, uint64_t now);
+#endif /* WHEEL_H */